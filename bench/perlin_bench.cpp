@@ -0,0 +1,176 @@
+// Perlin noise micro benchmark: compares every SIMD noise kernel this build has (SSE2, and
+// AVX with RAYTRACING_NATIVE on AVX hosts) against the scalar reference
+// `Perlin::NoiseScalar`, both for single octaves and for the 7-octave turbulence used by
+// `NoiseTexture`, and measures the baked `NoiseVolume` lookup against exact turbulence.
+// `Perlin::Noise` dispatches to whichever kernel wins here.
+//
+// usage: perlin_bench [point_count]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "aabb.h"
+#include "common.h"
+#include "perlin.h"
+#include "timer.h"
+#include "vec3.h"
+
+namespace {
+
+const int kRepeats = 5;
+const int kTurbDepth = 7;
+
+// Keeps the measured loops observable so the compiler cannot drop them.
+volatile double sink;
+
+using NoiseKernel = double (Perlin::*)(const point3&) const;
+
+// Perlin::Turb with the given noise kernel in place of Perlin::Noise
+double TurbWith(const Perlin& perlin, NoiseKernel noise, const point3& p, int depth) {
+  auto accum = 0.0;
+  auto temp_p = p;
+  auto weight = 1.0;
+
+  for (int i = 0; i < depth; i++) {
+    accum += weight * (perlin.*noise)(temp_p);
+    weight *= 0.5;
+    temp_p *= 2;
+  }
+
+  return std::fabs(accum);
+}
+
+// Returns the best-of-kRepeats time in seconds for evaluating `fn` over all points.
+template <typename Fn>
+double Measure(const std::vector<point3>& points, Fn fn, double& checksum) {
+  double best = kInfinity;
+  for (int r = 0; r < kRepeats; r++) {
+    double sum = 0;
+    Timer timer;
+    for (const auto& p : points)
+      sum += fn(p);
+    best = std::fmin(best, timer.Elapsed());
+    sink = sum;
+    checksum = sum;
+  }
+  return best;
+}
+
+void Report(const char* name, const char* kernel, size_t count, double scalar_s, double simd_s,
+            double max_err, double sum_delta) {
+  std::printf("%-6s %-5s scalar %8.2f ns/call   simd %8.2f ns/call   speedup %.2fx"
+              "   max|err| %.3g   sum delta %.3g\n",
+              name, kernel, 1e9 * scalar_s / count, 1e9 * simd_s / count, scalar_s / simd_s,
+              max_err, sum_delta);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t count = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : (1u << 20);
+
+  Perlin perlin;
+  std::vector<point3> points(count);
+  for (auto& p : points)
+    p = point3::random(-64, 64);
+
+#if defined(__SSE2__)
+  std::printf("Perlin::Noise uses: SSE2 (2 lanes)\n");
+#else
+  std::printf("Perlin::Noise uses: scalar fallback\n");
+#endif
+
+  struct Kernel {
+    const char* name;
+    NoiseKernel noise;
+  };
+  std::vector<Kernel> kernels;
+#if defined(__SSE2__)
+  kernels.push_back({"sse2", &Perlin::NoiseSse2});
+#endif
+#if defined(__AVX__)
+  kernels.push_back({"avx", &Perlin::NoiseAvx});
+#endif
+
+  double checksum_scalar, checksum_simd;
+  double noise_scalar = Measure(
+      points, [&](const point3& p) { return perlin.NoiseScalar(p); }, checksum_scalar);
+  double noise_checksum = checksum_scalar;
+  double turb_scalar = Measure(
+      points,
+      [&](const point3& p) { return TurbWith(perlin, &Perlin::NoiseScalar, p, kTurbDepth); },
+      checksum_scalar);
+  double turb_checksum = checksum_scalar;
+
+  double max_err = 0;
+  for (const auto& kernel : kernels) {
+    // Accuracy
+    double noise_err = 0, turb_err = 0;
+    for (const auto& p : points) {
+      noise_err =
+          std::fmax(noise_err, std::fabs((perlin.*kernel.noise)(p) - perlin.NoiseScalar(p)));
+      turb_err = std::fmax(turb_err, std::fabs(TurbWith(perlin, kernel.noise, p, kTurbDepth) -
+                                               TurbWith(perlin, &Perlin::NoiseScalar, p,
+                                                        kTurbDepth)));
+    }
+    max_err = std::fmax(max_err, std::fmax(noise_err, turb_err));
+
+    // Throughput
+    double noise_simd = Measure(
+        points, [&](const point3& p) { return (perlin.*kernel.noise)(p); }, checksum_simd);
+    Report("noise", kernel.name, count, noise_scalar, noise_simd, noise_err,
+           checksum_simd - noise_checksum);
+    double turb_simd = Measure(
+        points, [&](const point3& p) { return TurbWith(perlin, kernel.noise, p, kTurbDepth); },
+        checksum_simd);
+    Report("turb", kernel.name, count, turb_scalar, turb_simd, turb_err,
+           checksum_simd - turb_checksum);
+  }
+
+  // Baked turbulence over the bounding box of the small sphere in `PerlinSphere`.
+  AABB bounds(point3(-2, 0, -2), point3(2, 4, 2));
+  std::vector<point3> inside(count);
+  for (auto& p : inside)
+    p = point3(RandomDouble(-2, 2), RandomDouble(0, 4), RandomDouble(-2, 2));
+
+  double turb_exact = Measure(
+      inside, [&](const point3& p) { return perlin.Turb(p, kTurbDepth); }, checksum_simd);
+
+  for (int resolution : {64, 128, 256}) {
+    Timer bake_timer;
+    NoiseVolume volume(perlin, bounds, resolution, kTurbDepth);
+    double bake_s = bake_timer.Elapsed();
+
+    double sq_err = 0, max_err = 0;
+    for (const auto& p : inside) {
+      double baked;
+      volume.Lookup(p, baked);
+      double err = std::fabs(baked - perlin.Turb(p, kTurbDepth));
+      sq_err += err * err;
+      max_err = std::fmax(max_err, err);
+    }
+
+    double lookup_s = Measure(
+        inside,
+        [&](const point3& p) {
+          double baked;
+          volume.Lookup(p, baked);
+          return baked;
+        },
+        checksum_scalar);
+
+    std::printf("baked %3d^3  %6.1f MiB  bake %6.2fs   lookup %6.2f ns/call (exact %6.2f)"
+                "   speedup %.1fx   rms|err| %.3g   max|err| %.3g\n",
+                resolution, volume.MemoryBytes() / 1048576.0, bake_s, 1e9 * lookup_s / count,
+                1e9 * turb_exact / count, turb_exact / lookup_s, std::sqrt(sq_err / count),
+                max_err);
+  }
+
+  const double kTolerance = 1e-12;
+  if (max_err > kTolerance) {
+    std::fprintf(stderr, "FAIL: SIMD noise differs from the scalar reference\n");
+    return 1;
+  }
+  return 0;
+}
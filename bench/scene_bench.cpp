@@ -0,0 +1,298 @@
+// Benchmark suite over the built-in scenes.
+//
+// Every scene is rendered at a fixed resolution, sample count and seed, each in a forked
+// child process so that its peak RSS is its own. Results go to stdout as CSV or JSON. With
+// --baseline, rays/s are compared against an earlier CSV run and the exit status is 2 if any
+// scene got slower than the tolerance allows. --pin and --replicate runs compared this way
+// measure what a copy of the scene per NUMA node gains over a single shared copy.
+//
+// usage: scene_bench [options] [scene...]     (default: all built-in scenes)
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "scene.h"
+#include "scenes.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "timer.h"
+
+namespace {
+
+const char* kUsage = R"(usage: scene_bench [options] [scene...]
+
+options:
+  --width N          image width for every scene (default 160)
+  --spp N            samples per pixel (default 16)
+  --seed N           random seed (default 0)
+  --threads N        render threads, 0 = one per hardware thread (default)
+  --pin              pin each thread to a core, spread over the NUMA nodes
+  --replicate        give every NUMA node its own copy of the scene (implies --pin);
+                     compare against a --pin run for the single-copy baseline
+  --format csv|json  output format (default csv)
+  --baseline FILE    compare rays/s against a CSV from an earlier run
+  --tolerance F      allowed rays/s loss against the baseline (default 0.05 = 5%)
+)";
+
+struct Options {
+  int width = 160;
+  int spp = 16;
+  uint64_t seed = 0;
+  int threads = 0;
+  bool pin = false;
+  bool replicate = false;
+  std::string format = "csv";
+  std::string baseline;
+  double tolerance = 0.05;
+  std::vector<std::string> scenes;
+};
+
+// Measurements of one scene, passed from the child process through a pipe.
+struct Result {
+  char scene[64] = {};
+  int width = 0;
+  int height = 0;
+  double build_s = 0;
+  double render_s = 0;
+  uint64_t rays = 0;
+  uint64_t primitive_tests = 0;
+  long peak_rss_kb = 0;
+  int scene_copies = 1;  // One per NUMA node with --replicate
+  bool ok = false;
+
+  double RaysPerSecond() const { return render_s > 0 ? rays / render_s : 0; }
+
+  double TestsPerRay() const { return rays > 0 ? double(primitive_tests) / rays : 0; }
+};
+
+Result RunScene(const SceneEntry& entry, const Options& opt) {
+  Result result;
+  std::snprintf(result.scene, sizeof(result.scene), "%s", entry.name);
+
+  Scheduler::PinSharedThreads() = opt.pin;
+  Scheduler::Shared(opt.threads);
+
+  SeedRandom(opt.seed);
+  Timer timer;
+  Scene scene = entry.build();
+  std::vector<Scene> replicas;
+  std::vector<const Hittable*> node_worlds;
+  if (opt.replicate) {
+    // On the heap, like the original
+    replicas = BuildNodeReplicas(
+        [&](Scene& replica) { return (replica = entry.build(), true); }, opt.seed, false);
+    node_worlds.push_back(&scene.world);
+    for (const auto& replica : replicas)
+      node_worlds.push_back(&replica.world);
+  }
+  result.build_s = timer.Elapsed();
+  result.scene_copies = 1 + int(replicas.size());
+
+  Camera& cam = scene.cam;
+  cam.image_width = opt.width;
+  cam.samples_per_pixel = opt.spp;
+  cam.threads = opt.threads;
+  cam.seed = opt.seed;
+  cam.Render(scene.world, node_worlds);
+
+  result.width = cam.image_width;
+  result.height = cam.ImageHeight();
+  result.render_s = cam.RenderTime();
+  result.rays = cam.Stats().Rays();
+  result.primitive_tests = cam.Stats().PrimitiveTests();
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  result.peak_rss_kb = usage.ru_maxrss;  // Kilobytes on Linux
+  result.ok = true;
+  return result;
+}
+
+// Run one scene in a child process and collect its result.
+Result RunIsolated(const SceneEntry& entry, const Options& opt) {
+  int fd[2];
+  if (pipe(fd) != 0)
+    return Result();
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fd[0]);
+    std::clog.rdbuf(nullptr);  // Silence the render progress
+    Result result = RunScene(entry, opt);
+    ssize_t written = write(fd[1], &result, sizeof(result));
+    _exit(written == sizeof(result) ? 0 : 1);
+  }
+
+  close(fd[1]);
+  Result result;
+  if (pid < 0 || read(fd[0], &result, sizeof(result)) != sizeof(result))
+    result.ok = false;
+  close(fd[0]);
+  if (pid > 0)
+    waitpid(pid, nullptr, 0);
+  return result;
+}
+
+void WriteCsv(std::ostream& out, const std::vector<Result>& results, const Options& opt) {
+  out << "scene,width,height,spp,threads,seed,build_s,render_s,rays,rays_per_s,"
+         "primitive_tests_per_ray,peak_rss_kb,pinned,scene_copies\n";
+  for (const auto& r : results) {
+    out << r.scene << ',' << r.width << ',' << r.height << ',' << opt.spp << ',' << opt.threads
+        << ',' << opt.seed << ',' << r.build_s << ',' << r.render_s << ',' << r.rays << ','
+        << r.RaysPerSecond() << ',' << r.TestsPerRay() << ',' << r.peak_rss_kb << ','
+        << opt.pin << ',' << r.scene_copies << '\n';
+  }
+}
+
+void WriteJson(std::ostream& out, const std::vector<Result>& results, const Options& opt) {
+  out << "[\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    out << "  {\"scene\": \"" << r.scene << "\", \"width\": " << r.width
+        << ", \"height\": " << r.height << ", \"spp\": " << opt.spp
+        << ", \"threads\": " << opt.threads << ", \"seed\": " << opt.seed
+        << ", \"build_s\": " << r.build_s << ", \"render_s\": " << r.render_s
+        << ", \"rays\": " << r.rays << ", \"rays_per_s\": " << r.RaysPerSecond()
+        << ", \"primitive_tests_per_ray\": " << r.TestsPerRay()
+        << ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"pinned\": " << opt.pin
+        << ", \"scene_copies\": " << r.scene_copies << "}"
+        << (i + 1 < results.size() ? "," : "") << '\n';
+  }
+  out << "]\n";
+}
+
+// Reads scene -> rays_per_s from a CSV written by WriteCsv.
+bool ReadBaseline(const std::string& filename, std::map<std::string, double>& rays_per_s) {
+  std::ifstream in(filename);
+  if (!in) {
+    std::cerr << "ERROR: Could not read baseline '" << filename << "'.\n";
+    return false;
+  }
+
+  std::string line;
+  std::getline(in, line);  // header
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    for (std::string field; std::getline(ss, field, ',');)
+      fields.push_back(field);
+    if (fields.size() >= 10)
+      rays_per_s[fields[0]] = std::atof(fields[9].c_str());
+  }
+  return true;
+}
+
+// Prints the comparison to stderr; returns false if any scene regressed.
+bool CompareBaseline(const std::vector<Result>& results, const Options& opt) {
+  std::map<std::string, double> baseline;
+  if (!ReadBaseline(opt.baseline, baseline))
+    return false;
+
+  bool ok = true;
+  std::fprintf(stderr, "%-22s %14s %14s %9s\n", "scene", "baseline ray/s", "current ray/s",
+               "change");
+  for (const auto& r : results) {
+    auto it = baseline.find(r.scene);
+    if (it == baseline.end() || it->second <= 0) {
+      std::fprintf(stderr, "%-22s %14s %14.0f\n", r.scene, "-", r.RaysPerSecond());
+      continue;
+    }
+    double change = r.RaysPerSecond() / it->second - 1;
+    bool regressed = change < -opt.tolerance;
+    ok = ok && !regressed;
+    std::fprintf(stderr, "%-22s %14.0f %14.0f %+8.1f%%%s\n", r.scene, it->second,
+                 r.RaysPerSecond(), 100 * change, regressed ? "  REGRESSION" : "");
+  }
+  return ok;
+}
+
+bool ParseOptions(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--width" && has_value) {
+      opt.width = std::atoi(argv[++i]);
+    } else if (arg == "--spp" && has_value) {
+      opt.spp = std::atoi(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      opt.seed = std::strtoull(argv[++i], nullptr, 0);
+    } else if (arg == "--threads" && has_value) {
+      opt.threads = std::atoi(argv[++i]);
+    } else if (arg == "--pin") {
+      opt.pin = true;
+    } else if (arg == "--replicate") {
+      opt.replicate = opt.pin = true;
+    } else if (arg == "--format" && has_value) {
+      opt.format = argv[++i];
+    } else if (arg == "--baseline" && has_value) {
+      opt.baseline = argv[++i];
+    } else if (arg == "--tolerance" && has_value) {
+      opt.tolerance = std::atof(argv[++i]);
+    } else if (arg[0] != '-') {
+      if (!FindScene(arg)) {
+        std::cerr << "ERROR: unknown scene '" << arg << "'\n";
+        return false;
+      }
+      opt.scenes.push_back(arg);
+    } else {
+      std::cerr << "ERROR: bad option '" << arg << "'\n";
+      return false;
+    }
+  }
+  if (opt.width < 1 || opt.spp < 1 || opt.threads < 0 ||
+      (opt.format != "csv" && opt.format != "json")) {
+    std::cerr << "ERROR: bad option value\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!ParseOptions(argc, argv, opt)) {
+    std::cerr << kUsage;
+    return 1;
+  }
+
+#ifndef RAYTRACING_STATS
+  std::cerr << "WARNING: built without RAYTRACING_STATS, ray counts will be zero\n";
+#endif
+
+  if (opt.scenes.empty())
+    for (const auto& entry : BuiltinScenes())
+      opt.scenes.push_back(entry.name);
+
+  std::vector<Result> results;
+  for (const auto& name : opt.scenes) {
+    std::cerr << "running " << name << "..." << std::endl;
+    Result result = RunIsolated(*FindScene(name), opt);
+    if (!result.ok) {
+      std::cerr << "ERROR: scene '" << name << "' failed\n";
+      return 1;
+    }
+    results.push_back(result);
+  }
+
+  if (opt.format == "json")
+    WriteJson(std::cout, results, opt);
+  else
+    WriteCsv(std::cout, results, opt);
+
+  if (!opt.baseline.empty() && !CompareBaseline(results, opt))
+    return 2;
+  return 0;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that live and die together, such as everything a scene builds.
+// Allocations are carved out of large blocks one after the other, so objects built in order
+// sit next to each other in memory, and the blocks are released all at once when the arena
+// goes away. Individual deallocations do nothing.
+class Arena {
+public:
+  explicit Arena(size_t block_size = size_t(1) << 20) : block_size_(block_size) {}
+
+  ~Arena() {
+    for (void* block : blocks_)
+      std::free(block);
+  }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Thread-safe; `alignment` must be a power of two no larger than alignof(max_align_t).
+  void* Allocate(size_t bytes, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+    if (blocks_.empty() || offset + bytes > capacity_) {
+      capacity_ = std::max(block_size_, bytes);
+      void* block = std::malloc(capacity_);
+      if (!block)
+        throw std::bad_alloc();
+      blocks_.push_back(block);
+      reserved_ += capacity_;
+      offset = 0;
+    }
+    used_ = offset + bytes;
+    allocated_ += bytes;
+    return static_cast<char*>(blocks_.back()) + offset;
+  }
+
+  // Bytes handed out so far
+  size_t BytesAllocated() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocated_;
+  }
+
+  // Bytes of all blocks
+  size_t BytesReserved() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reserved_;
+  }
+
+private:
+  size_t block_size_;
+  std::vector<void*> blocks_;
+  size_t capacity_ = 0;  // Size of the current block, the last one
+  size_t used_ = 0;      // Bytes used of the current block
+  size_t allocated_ = 0;
+  size_t reserved_ = 0;
+  mutable std::mutex mutex_;
+};
+
+// Standard allocator over an Arena. Each copy keeps the arena alive, so objects made with
+// std::allocate_shared may outlive whoever created the arena: it is freed together with the
+// last of them.
+template <class T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(std::shared_ptr<Arena> arena) : arena_(std::move(arena)) {}
+
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T))); }
+
+  void deallocate(T*, size_t) {}
+
+  template <class U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena_;
+  }
+
+private:
+  template <class U>
+  friend class ArenaAllocator;
+
+  std::shared_ptr<Arena> arena_;
+};
+
+// The arena that MakeShared allocates from, shared by all threads; null for the heap.
+inline std::shared_ptr<Arena> ActiveArena(const std::shared_ptr<Arena>* replacement = nullptr) {
+  static std::mutex mutex;
+  static std::shared_ptr<Arena> active;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<Arena> current = active;
+  if (replacement)
+    active = *replacement;
+  return current;
+}
+
+// Makes `arena` the active arena for the lifetime of the scope.
+class ArenaScope {
+public:
+  explicit ArenaScope(std::shared_ptr<Arena> arena) : previous_(ActiveArena(&arena)) {}
+
+  ~ArenaScope() { ActiveArena(&previous_); }
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+  std::shared_ptr<Arena> previous_;
+};
+
+// std::make_shared, but placing the object and its control block in the active arena if
+// there is one.
+template <class T, class... Args>
+std::shared_ptr<T> MakeShared(Args&&... args) {
+  if (auto arena = ActiveArena())
+    return std::allocate_shared<T>(ArenaAllocator<T>(std::move(arena)),
+                                   std::forward<Args>(args)...);
+  return std::make_shared<T>(std::forward<Args>(args)...);
+}
@@ -3,6 +3,7 @@
 #include "interval.h"
 #include "vec3.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -34,3 +35,13 @@ void write_color(std::ostream& out, const color& pixel_color) {
   // Write out the pixel color components.
   out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
 }
+
+// False-color ramp for t in [0, 1]: blue -> cyan -> green -> yellow -> red.
+inline color HeatmapColor(double t) {
+  static const color kStops[] = {color(0, 0, 1), color(0, 1, 1), color(0, 1, 0), color(1, 1, 0),
+                                 color(1, 0, 0)};
+  t = Interval(0, 1).Clamp(t) * 4;
+  int i = std::min(int(t), 3);
+  double f = t - i;
+  return (1 - f) * kStops[i] + f * kStops[i + 1];
+}
@@ -1,13 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <limits>
 #include <memory>
-#include <random>
 
 // C++ Std Usings
 using std::make_shared;
 using std::shared_ptr;
 
+// Scalar type of the geometry core (vec3, Ray, Interval, AABB). Double unless the renderer
+// is built with RAYTRACING_FLOAT, which halves the size of rays, boxes and primitive data.
+#ifdef RAYTRACING_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 const double kInfinity = std::numeric_limits<double>::infinity();
 const double kPi = 3.1415926535897932385;
@@ -17,15 +25,63 @@ inline double Deg2Rad(double degress) {
   return degress * kPi / 180.0;
 }
 
+// Small, fast PCG32 generator (pcg-random.org). Unlike std::mt19937 it is cheap to seed, so
+// the renderer can reseed per pixel and get the same image for any number of threads.
+class Pcg32 {
+public:
+  Pcg32() { Seed(0); }
+
+  void Seed(uint64_t seed, uint64_t stream = 0) {
+    state_ = 0;
+    inc_ = (stream << 1) | 1;
+    Next();
+    state_ += seed;
+    Next();
+  }
+
+  uint32_t Next() {
+    uint64_t old = state_;
+    state_ = old * 6364136223846793005ULL + inc_;
+    auto xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+    auto rot = uint32_t(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+  }
+
+private:
+  uint64_t state_;
+  uint64_t inc_;
+};
+
+// Finalizer of splitmix64: turns structured integers (pixel indices, seeds) into
+// well-scrambled 64-bit values.
+inline uint64_t MixBits(uint64_t v) {
+  v ^= v >> 31;
+  v *= 0x7fb5d329728ea185ULL;
+  v ^= v >> 27;
+  v *= 0x81dadef4bc2dd44dULL;
+  v ^= v >> 33;
+  return v;
+}
+
+// Every thread owns its generator, so render threads never share random state.
+inline Pcg32& RandomGenerator() {
+  static thread_local Pcg32 generator;
+  return generator;
+}
+
+// Restart the calling thread's random sequence.
+inline void SeedRandom(uint64_t seed) {
+  RandomGenerator().Seed(MixBits(seed));
+}
+
 // Returns a random real in [0, 1)
 inline double RandomDouble() {
   // This is the old wary
   // return std::rand() / (RAND_MAX + 1.0);
 
-  // Now we can...
-  static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-  static std::mt19937 generator;
-  return distribution(generator);
+  // Then a static std::mt19937 with std::uniform_real_distribution, which is not safe to
+  // share between render threads. Now a thread-local PCG32:
+  return RandomGenerator().Next() * 0x1p-32;
 }
 
 // Returns a random real in [min, max)
@@ -6,7 +6,7 @@ class Interval {
 public:
   Interval() : min(kInfinity), max(-kInfinity) {}
 
-  Interval(double min, double max) : min(min), max(max) {}
+  Interval(real min, real max) : min(min), max(max) {}
 
   // Create the interval tightly enclosing the tow input intervals
   Interval(const Interval& a,const Interval& b) {
@@ -14,19 +14,19 @@ public:
     max = std::max(a.max, b.max);
   }
 
-  double Size() const { return max - min; }
+  real Size() const { return max - min; }
 
-  bool Contains(double x) const { return x >= min && x <= max; }
+  bool Contains(real x) const { return x >= min && x <= max; }
 
-  bool Surrounds(double x) const { return x > min && x < max; }
+  bool Surrounds(real x) const { return x > min && x < max; }
 
-  double Clamp(double x) const {
+  real Clamp(real x) const {
     if (x < min) return min;
     if (x > max) return max;
     return x;
   }
 
-  Interval Expand(double delta) const {
+  Interval Expand(real delta) const {
     auto padding = delta / 2;
     return Interval(min - padding, max + padding);
 
@@ -35,16 +35,16 @@ public:
   static const Interval empty, universe;
 
 public:
-  double min, max;
+  real min, max;
 };
 
 const Interval Interval::empty    = Interval( kInfinity, -kInfinity);
 const Interval Interval::universe = Interval(-kInfinity,  kInfinity);
 
-Interval operator+(const Interval& ival, double displacement) {
+Interval operator+(const Interval& ival, real displacement) {
   return Interval(ival.min + displacement, ival.max + displacement);
 }
 
-Interval operator+(double displacement, const Interval& ival) {
+Interval operator+(real displacement, const Interval& ival) {
   return ival + displacement;
 }
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "topology.h"
+
+// Work-stealing task scheduler. Every worker owns a deque: it pushes and pops its own tasks
+// at the back, so nested fork-join work stays on the thread that made it, while idle workers
+// steal from the front of the others' deques, taking the oldest task. The thread that waits
+// for a group of tasks runs tasks too, so the calling thread is one of the ThreadCount()
+// workers and a scheduler of one thread runs everything inline.
+//
+// Pinned schedulers tie thread i to the i-th CPU of CpuTopology::PinOrder, the calling
+// thread included, so that tasks can tell which NUMA node they run on.
+class Scheduler {
+public:
+  // Tasks in flight that a caller waits for together.
+  class TaskGroup {
+  public:
+    bool Done() const { return pending_.load() == 0; }
+
+  private:
+    friend class Scheduler;
+    std::atomic<int> pending_ = 0;
+  };
+
+  explicit Scheduler(int threads, bool pin = false)
+      : deques_(std::max(threads, 1)), cpus_(ThreadCount(), -1), nodes_(ThreadCount(), 0) {
+    if (pin) {
+      std::vector<int> order = CpuTopology::Get().PinOrder();
+      for (int index = 0; index < ThreadCount(); index++) {
+        cpus_[index] = order[index % order.size()];
+        nodes_[index] = CpuTopology::Get().NodeOfCpu(cpus_[index]);
+      }
+      PinThread(cpus_[0]);
+    }
+    for (int index = 1; index < ThreadCount(); index++)
+      workers_.emplace_back([this, index] { WorkerLoop(index); });
+  }
+
+  ~Scheduler() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+      worker.join();
+  }
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  int ThreadCount() const { return int(deques_.size()); }
+
+  bool Pinned() const { return cpus_[0] >= 0; }
+
+  // NUMA node of the calling thread; always 0 unless pinned.
+  int CurrentNode() const { return nodes_[Self()]; }
+
+  // The scheduler shared by the renderer, the BVH build and texture preprocessing, with
+  // `threads` threads (0 = the current count, initially one per hardware thread), pinned if
+  // PinSharedThreads() is set. Asking for a different setup replaces it, so only do that from
+  // the main thread while no tasks run.
+  static Scheduler& Shared(int threads = 0) {
+    static std::unique_ptr<Scheduler> shared;
+    if (threads <= 0)
+      threads = shared ? shared->ThreadCount() : HardwareThreads();
+    if (!shared || shared->ThreadCount() != threads || shared->Pinned() != PinSharedThreads()) {
+      shared.reset();
+      shared = std::make_unique<Scheduler>(threads, PinSharedThreads());
+    }
+    return *shared;
+  }
+
+  // Whether the shared scheduler pins its threads; takes effect on the next Shared() call.
+  static bool& PinSharedThreads() {
+    static bool pin = false;
+    return pin;
+  }
+
+  static int HardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+  // Queue `task` on the calling worker's deque as part of `group`.
+  void Spawn(TaskGroup& group, std::function<void()> task) {
+    group.pending_++;
+    Push(Self(), Task{std::move(task), &group});
+    Notify(false);
+  }
+
+  // Run queued tasks, stolen ones included, until every task of `group` has finished.
+  void Wait(TaskGroup& group) {
+    int self = Self();
+    while (!group.Done()) {
+      if (auto task = Take(self)) {
+        Execute(*task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [&] { return group.Done() || queued_.load() > 0; });
+    }
+  }
+
+  // Run `a` and `b` in parallel and return when both are done. `b` is offered for stealing
+  // while the caller runs `a`, and is run by the caller too if nobody took it meanwhile.
+  template <class A, class B>
+  void Invoke(A&& a, B&& b) {
+    if (ThreadCount() == 1) {
+      a();
+      b();
+      return;
+    }
+    TaskGroup group;
+    Spawn(group, std::forward<B>(b));
+    a();
+    Wait(group);
+  }
+
+  // Run body(i) for i in [0, count), starting them in about increasing i, and return when all
+  // are done. The indices are dealt round-robin to the workers' deques so that each worker
+  // starts with its own lowest index; workers that run dry steal the highest index left, so
+  // callers that order the work by decreasing cost leave only the cheapest items to balance
+  // the end.
+  void ParallelFor(int count, const std::function<void(int)>& body) {
+    if (ThreadCount() == 1) {
+      for (int i = 0; i < count; i++)
+        body(i);
+      return;
+    }
+    TaskGroup group;
+    group.pending_ += count;
+    int self = Self();
+    for (int i = count - 1; i >= 0; i--)
+      Push((self + i) % ThreadCount(), Task{[&body, i] { body(i); }, &group});
+    Notify(true);
+    Wait(group);
+  }
+
+private:
+  struct Task {
+    std::function<void()> run;
+    TaskGroup* group;
+  };
+
+  struct WorkerDeque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // Deque index of the calling thread: its own if it is one of our workers, else the first,
+  // which belongs to whoever calls in from outside.
+  int Self() const { return CurrentScheduler() == this ? CurrentIndex() : 0; }
+
+  static const Scheduler*& CurrentScheduler() {
+    static thread_local const Scheduler* scheduler = nullptr;
+    return scheduler;
+  }
+
+  static int& CurrentIndex() {
+    static thread_local int index = 0;
+    return index;
+  }
+
+  void WorkerLoop(int index) {
+    CurrentScheduler() = this;
+    CurrentIndex() = index;
+    if (cpus_[index] >= 0)
+      PinThread(cpus_[index]);
+    for (;;) {
+      if (auto task = Take(index)) {
+        Execute(*task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [&] { return stop_ || queued_.load() > 0; });
+      if (stop_ && queued_.load() == 0)
+        return;
+    }
+  }
+
+  void Push(int index, Task task) {
+    std::lock_guard<std::mutex> lock(deques_[index].mutex);
+    deques_[index].tasks.push_back(std::move(task));
+    queued_++;
+  }
+
+  // Pop the newest task of deque `self`, or else steal the oldest task of another deque.
+  std::optional<Task> Take(int self) {
+    for (int n = 0; n < ThreadCount(); n++) {
+      int index = (self + n) % ThreadCount();
+      std::lock_guard<std::mutex> lock(deques_[index].mutex);
+      auto& tasks = deques_[index].tasks;
+      if (tasks.empty())
+        continue;
+      Task task = std::move(n == 0 ? tasks.back() : tasks.front());
+      if (n == 0)
+        tasks.pop_back();
+      else
+        tasks.pop_front();
+      queued_--;
+      return task;
+    }
+    return std::nullopt;
+  }
+
+  void Execute(Task& task) {
+    task.run();
+    // The group may be gone as soon as its count drops to zero, so it is not touched after.
+    if (--task.group->pending_ == 0)
+      Notify(true);
+  }
+
+  // Wake a sleeping worker, or all sleepers. Taking the lock orders the wake-up after the
+  // sleepers' check of their condition, so none of them misses it.
+  void Notify(bool all) {
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    if (all)
+      wake_.notify_all();
+    else
+      wake_.notify_one();
+  }
+
+private:
+  std::vector<WorkerDeque> deques_;  // One per thread, the caller's first
+  std::vector<std::thread> workers_;
+  std::vector<int> cpus_;            // CPU of each thread, -1 if not pinned
+  std::vector<int> nodes_;           // NUMA node of each thread
+  std::atomic<int> queued_ = 0;      // Tasks in all deques
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// The CPUs this process may run on, grouped by NUMA node, as Linux reports them under
+// /sys/devices/system/node. Elsewhere, or if that is missing, all CPUs form node 0.
+class CpuTopology {
+public:
+  static const CpuTopology& Get() {
+    static const CpuTopology topology = Detect();
+    return topology;
+  }
+
+  int NodeCount() const { return int(node_cpus_.size()); }
+
+  const std::vector<int>& NodeCpus(int node) const { return node_cpus_[node]; }
+
+  // CPUs in the order to pin threads to: round-robin over the nodes, so that any number of
+  // threads is spread evenly over the sockets.
+  std::vector<int> PinOrder() const {
+    std::vector<int> order;
+    for (size_t rank = 0; order.size() < CpuCount(); rank++)
+      for (const auto& cpus : node_cpus_)
+        if (rank < cpus.size())
+          order.push_back(cpus[rank]);
+    return order;
+  }
+
+  int NodeOfCpu(int cpu) const {
+    for (int node = 0; node < NodeCount(); node++)
+      for (int c : node_cpus_[node])
+        if (c == cpu)
+          return node;
+    return 0;
+  }
+
+private:
+  size_t CpuCount() const {
+    size_t count = 0;
+    for (const auto& cpus : node_cpus_)
+      count += cpus.size();
+    return count;
+  }
+
+  static CpuTopology Detect() {
+    CpuTopology topology;
+    std::vector<int> allowed = AllowedCpus();
+    for (int node = 0;; node++) {
+      std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      std::string list;
+      if (!in || !std::getline(in, list))
+        break;
+      std::vector<int> cpus;
+      for (int cpu : ParseCpuList(list))
+        for (int a : allowed)
+          if (a == cpu)
+            cpus.push_back(cpu);
+      if (!cpus.empty())
+        topology.node_cpus_.push_back(cpus);
+    }
+    if (topology.node_cpus_.empty())
+      topology.node_cpus_.push_back(allowed);
+    return topology;
+  }
+
+  // CPUs of the process affinity mask, or 0..n-1 if it cannot be read.
+  static std::vector<int> AllowedCpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+          cpus.push_back(cpu);
+    }
+#endif
+    if (cpus.empty())
+      for (int cpu = 0; cpu < int(std::max(1u, std::thread::hardware_concurrency())); cpu++)
+        cpus.push_back(cpu);
+    return cpus;
+  }
+
+  // "0-3,8,10-11" -> 0 1 2 3 8 10 11
+  static std::vector<int> ParseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    for (std::string range; std::getline(ss, range, ',');) {
+      int first, last;
+      char dash;
+      std::stringstream rs(range);
+      if (!(rs >> first))
+        continue;
+      last = (rs >> dash >> last) ? last : first;
+      for (int cpu = first; cpu <= last; cpu++)
+        cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+private:
+  std::vector<std::vector<int>> node_cpus_;
+};
+
+// Restrict the calling thread to `cpu`. Returns false where that is not supported.
+inline bool PinThread(int cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+// Run `task` on a new thread pinned to the first CPU of `node` and wait for it. Memory that
+// the task touches first is then, under Linux's default first-touch policy, on that node.
+template <class Task>
+void RunOnNode(int node, Task&& task) {
+  std::thread thread([&] {
+    PinThread(CpuTopology::Get().NodeCpus(node).front());
+    task();
+  });
+  thread.join();
+}
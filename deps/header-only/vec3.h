@@ -1,29 +1,97 @@
 #pragma once
 
+#include <bit>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <type_traits>
 #include "common.h"
 
 // ----------------------------------------------------------------------------: class
+#ifdef RAYTRACING_SIMD_VEC3
+// Four-lane vec3 on GCC/Clang vector extensions, which compile to SSE or AVX depending on
+// the target (-march). The fourth lane is padding and stays zero. Lane arithmetic happens in
+// the same order as in the scalar class below, so both give bit-identical images.
 class vec3 {
 public:
-  double e[3];
+  using Lanes = real __attribute__((vector_size(4 * sizeof(real))));
+
+  union {
+    Lanes v;
+    real e[4];
+  };
+
+  vec3() : v{0, 0, 0, 0} {}
+
+  vec3(real e0, real e1, real e2) : v{e0, e1, e2, 0} {}
+
+  explicit vec3(Lanes lanes) : v(lanes) {}
+
+  real x() const { return e[0]; }
+
+  real y() const { return e[1]; }
+
+  real z() const { return e[2]; }
+
+  vec3 operator-() const { return vec3(-v); }
+
+  real operator[](int i) const { return e[i]; }
+
+  real& operator[](int i) { return e[i]; }
+
+  vec3& operator+=(const vec3& u) {
+    v += u.v;
+    return *this;
+  }
+
+  vec3& operator*=(real t) {
+    v *= t;
+    return *this;
+  }
+
+  vec3& operator/=(real t) { return *this *= 1 / t; }
+
+  real length() const { return std::sqrt(length_squared()); }
+
+  real length_squared() const {
+    Lanes squared = v * v;
+    return squared[0] + squared[1] + squared[2];
+  }
+
+  // Return true if the vector is close to zero in all dimensions.
+  bool near_zero() const {
+    real s = 1e-8;
+    return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
+  }
+
+  static vec3 random() {
+    return vec3(RandomDouble(), RandomDouble(),RandomDouble());
+  }
+
+  static vec3 random(real min, real max) {
+    return vec3(RandomDouble(min, max), RandomDouble(min, max),RandomDouble(min, max));
+  }
+};
+#else
+class vec3 {
+public:
+  real e[3];
 
   vec3() : e{0, 0, 0} {}
 
-  vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+  vec3(real e0, real e1, real e2) : e{e0, e1, e2} {}
 
-  double x() const { return e[0]; }
+  real x() const { return e[0]; }
 
-  double y() const { return e[1]; }
+  real y() const { return e[1]; }
 
-  double z() const { return e[2]; }
+  real z() const { return e[2]; }
 
   vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
 
-  double operator[](int i) const { return e[i]; }
+  real operator[](int i) const { return e[i]; }
 
-  double& operator[](int i) { return e[i]; }
+  real& operator[](int i) { return e[i]; }
 
   vec3& operator+=(const vec3& v) {
     e[0] += v.e[0];
@@ -32,22 +100,22 @@ public:
     return *this;
   }
 
-  vec3& operator*=(double t) {
+  vec3& operator*=(real t) {
     e[0] *= t;
     e[1] *= t;
     e[2] *= t;
     return *this;
   }
 
-  vec3& operator/=(double t) { return *this *= 1 / t; }
+  vec3& operator/=(real t) { return *this *= 1 / t; }
 
-  double length() const { return std::sqrt(length_squared()); }
+  real length() const { return std::sqrt(length_squared()); }
 
-  double length_squared() const { return e[0] * e[0] + e[1] * e[1] + e[2] * e[2]; }
+  real length_squared() const { return e[0] * e[0] + e[1] * e[1] + e[2] * e[2]; }
 
   // Return true if the vector is close to zero in all dimensions.
   bool near_zero() const {
-    double s = 1e-8;
+    real s = 1e-8;
     // Check x, y, z
     return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
   }
@@ -56,10 +124,11 @@ public:
     return vec3(RandomDouble(), RandomDouble(),RandomDouble());
   }
 
-  static vec3 random(double min, double max) {
+  static vec3 random(real min, real max) {
     return vec3(RandomDouble(min, max), RandomDouble(min, max),RandomDouble(min, max));
   }
 };
+#endif
 
 // ----------------------------------------------------------------------------: alias
 // point3 is just an alias for vec3,
@@ -72,6 +141,45 @@ inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
   return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
+#ifdef RAYTRACING_SIMD_VEC3
+inline vec3 operator+(const vec3& u, const vec3& v) {
+  return vec3(u.v + v.v);
+}
+
+inline vec3 operator-(const vec3& u, const vec3& v) {
+  return vec3(u.v - v.v);
+}
+
+inline vec3 operator*(const vec3& u, const vec3& v) {
+  return vec3(u.v * v.v);
+}
+
+inline vec3 operator*(real t, const vec3& v) {
+  return vec3(t * v.v);
+}
+
+inline vec3 operator*(const vec3& v, real t) {
+  return t * v;
+}
+
+inline vec3 operator/(const vec3& v, real t) {
+  return (1 / t) * v;
+}
+
+inline real dot(const vec3& u, const vec3& v) {
+  vec3::Lanes product = u.v * v.v;
+  return product[0] + product[1] + product[2];
+}
+
+inline vec3 cross(const vec3& u, const vec3& v) {
+  // u.yzx * v.zxy - u.zxy * v.yzx; the padding lane computes 0 * 0 - 0 * 0.
+  auto u_yzx = __builtin_shufflevector(u.v, u.v, 1, 2, 0, 3);
+  auto u_zxy = __builtin_shufflevector(u.v, u.v, 2, 0, 1, 3);
+  auto v_yzx = __builtin_shufflevector(v.v, v.v, 1, 2, 0, 3);
+  auto v_zxy = __builtin_shufflevector(v.v, v.v, 2, 0, 1, 3);
+  return vec3(u_yzx * v_zxy - u_zxy * v_yzx);
+}
+#else
 inline vec3 operator+(const vec3& u, const vec3& v) {
   return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
@@ -84,19 +192,19 @@ inline vec3 operator*(const vec3& u, const vec3& v) {
   return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3& v) {
+inline vec3 operator*(real t, const vec3& v) {
   return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-inline vec3 operator*(const vec3& v, double t) {
+inline vec3 operator*(const vec3& v, real t) {
   return t * v;
 }
 
-inline vec3 operator/(const vec3& v, double t) {
+inline vec3 operator/(const vec3& v, real t) {
   return (1 / t) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+inline real dot(const vec3& u, const vec3& v) {
   return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
 
@@ -104,28 +212,50 @@ inline vec3 cross(const vec3& u, const vec3& v) {
   return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1], u.e[2] * v.e[0] - u.e[0] * v.e[2],
               u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
+#endif
 
 inline vec3 unit_vector(const vec3& v) {
   return v / v.length();
 }
 
+// Map a point (u1, u2) of the unit square to the unit disk, keeping areas proportional.
+// Shirley and Chiu's concentric mapping: squares around the center go to circles, so strata
+// of (u1, u2) stay compact on the disk.
+inline vec3 sample_unit_disk(real u1, real u2) {
+  real a = 2 * u1 - 1;
+  real b = 2 * u2 - 1;
+  if (a == 0 && b == 0)
+    return vec3(0, 0, 0);
+
+  real r, phi;
+  if (std::fabs(a) > std::fabs(b)) {
+    r = a;
+    phi = (kPi / 4) * (b / a);
+  } else {
+    r = b;
+    phi = (kPi / 2) - (kPi / 4) * (a / b);
+  }
+  return vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+// Map a point (u1, u2) of the unit square uniformly onto the unit sphere: z is uniform in
+// [-1, 1] (Archimedes' hat-box theorem) and the azimuth uniform in [0, 2pi).
+inline vec3 sample_unit_vector(real u1, real u2) {
+  real z = 1 - 2 * u1;
+  real r = std::sqrt(std::fmax(0, 1 - z * z));
+  real phi = 2 * kPi * u2;
+  return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
 // Generate random point inside unit disk
 inline vec3 random_in_unit_disk() {
-  while (true) {
-    auto p = vec3(RandomDouble(-1, 1), RandomDouble(-1, 1), 0);
-    if (p.length_squared() < 1)
-      return p;
-  }
+  // Was a rejection loop, which draws a varying number of random numbers.
+  return sample_unit_disk(RandomDouble(), RandomDouble());
 }
 
-// A rejection method to generate the random vector inside the unit sphere
+// Generate a random unit vector, uniform over the sphere
 inline vec3 random_unit_vector() {
-  while (true) {
-    auto p = vec3::random(-1, 1);
-    auto lensq = p.length_squared();
-    if (lensq >= 1e-160 && lensq <= 1)
-      return p / sqrt(lensq);
-  }
+  return sample_unit_vector(RandomDouble(), RandomDouble());
 }
 
 inline vec3 random_on_hemispshere(const vec3& normal) {
@@ -140,9 +270,33 @@ inline vec3 reflect(const vec3& v, const vec3& n) {
   return v - 2 * dot(v, n) * n;
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-  double cos_theta = std::fmin(dot(-uv, n), 1.0);
+inline vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat) {
+  real cos_theta = std::fmin(dot(-uv, n), 1.0);
   vec3 r_out_prep = etai_over_etat * (uv + cos_theta * n);
   vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_prep.length_squared())) * n;
   return r_out_prep + r_out_parallel;
 }
+
+// Move the origin p of a ray leaving a surface off that surface, along the geometric normal n
+// on the side the ray leaves from, so the ray cannot hit the surface it starts on again.
+// Wachter and Binder, "A Fast and Robust Method for Avoiding Self-Intersection" (Ray Tracing
+// Gems, ch. 6): p moves by a fixed number of ulps, which scales with its magnitude like the
+// rounding error of the hit point does, and by a small absolute step near the origin where
+// ulps get arbitrarily small.
+inline point3 offset_ray_origin(const point3& p, const vec3& n) {
+  using Bits = std::conditional_t<sizeof(real) == 4, int32_t, int64_t>;
+  constexpr real kOrigin = 1.0 / 32;
+  constexpr real kFloatScale = 1.0 / 65536;
+  // 256 ulps is the paper's float constant. Doubles need more: the grazing-angle rounding of
+  // Sphere::Hit's quadratic shrinks more slowly than the ulp does.
+  constexpr real kIntScale = sizeof(real) == 4 ? 256 : 65536;
+
+  point3 result;
+  for (int i = 0; i < 3; i++) {
+    auto offset = Bits(kIntScale * n[i]);
+    auto bits = std::bit_cast<Bits>(p[i]) + (p[i] < 0 ? -offset : offset);
+    result[i] = std::fabs(p[i]) < kOrigin ? p[i] + kFloatScale * n[i]
+                                          : std::bit_cast<real>(bits);
+  }
+  return result;
+}
@@ -2,6 +2,7 @@
 
 #include "interval.h"
 #include "ray.h"
+#include "stats.h"
 #include "vec3.h"
 
 class AABB {
@@ -40,14 +41,19 @@ public:
     return x;
   }
 
-  bool Hit(const Ray& r, Interval ray_t) const {
+  bool Hit(const Ray& r, Interval ray_t) const { return Clip(r, ray_t); }
+
+  // Narrow `ray_t` to the part of the ray inside the box. Returns false if nothing is left.
+  bool Clip(const Ray& r, Interval& ray_t) const {
+    RT_STAT(box_tests);
+
     const point3& ray_orig = r.origin();
     const vec3& ray_dir = r.direction();
 
     for (int axis = 0; axis < 3; axis++) {
       https://tinyurl.com/2t5s7ptj
       const Interval& ax = AxisInterval(axis);
-      const double ad_inv = 1.0 / ray_dir[axis];
+      const real ad_inv = 1 / ray_dir[axis];
 
       auto t0 = (ax.min - ray_orig[axis]) * ad_inv;
       auto t1 = (ax.max - ray_orig[axis]) * ad_inv;
@@ -67,9 +73,9 @@ public:
 
   // Return the index of the longest axis of the bounding box
   int LongestAxis() const {
-    double x_size = x.Size();
-    double y_size = y.Size();
-    double z_size = z.Size();
+    real x_size = x.Size();
+    real y_size = y.Size();
+    real z_size = z.Size();
 
     if (x_size > y_size && x_size > z_size)
         return 0;
@@ -81,7 +87,7 @@ public:
 private:
   // Adjust the AABB so that no side is narrower than some delta, padding if necessary.
   void PadToMinmums() {
-    double delta = 0.0001;
+    real delta = 0.0001;
     if (x.Size() < delta) x = x.Expand(delta);
     if (y.Size() < delta) y = y.Expand(delta);
     if (z.Size() < delta) z = z.Expand(delta);
@@ -104,3 +110,17 @@ AABB operator+(const AABB& bbox, const vec3& offset) {
 AABB operator+(const vec3& offset, const AABB& bbox) {
   return bbox + offset;
 }
+
+// The box between `a` (f = 0) and `b` (f = 1). If an object moves linearly from inside `a` to
+// inside `b`, the interpolated box at f bounds the object at the matching time.
+inline AABB Lerp(const AABB& a, const AABB& b, real f) {
+  // Both boxes are padded already, so the result needs no padding of its own.
+  AABB box;
+  for (int axis = 0; axis < 3; axis++) {
+    const Interval& i = a.AxisInterval(axis);
+    const Interval& j = b.AxisInterval(axis);
+    Interval& result = axis == 0 ? box.x : axis == 1 ? box.y : box.z;
+    result = Interval(i.min + f * (j.min - i.min), i.max + f * (j.max - i.max));
+  }
+  return box;
+}
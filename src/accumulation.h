@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "color.h"
+#include "vec3.h"
+
+// Unnormalized result of rendering the samples [first, last) of every pixel: the sum of the
+// sample colors and the number of samples per pixel. Accumulations of adjacent sample ranges
+// of the same frame add up to the accumulation of their union, so a frame can be rendered in
+// pieces, by different processes or machines, and merged afterwards. The sample range, the
+// random seed and the image size are recorded so that pieces of different frames, or
+// samples counted twice, are caught when merging.
+//
+// Binary form: a Header, then width * height RGB sums as doubles, then as many uint32
+// sample counts, all row by row in host byte order.
+class Accumulation {
+public:
+  Accumulation() {}
+
+  Accumulation(int width, int height, int first_sample, int last_sample, uint64_t seed)
+      : width_(width), height_(height), first_sample_(first_sample), last_sample_(last_sample),
+        seed_(seed), sums_(size_t(width) * height, color(0, 0, 0)),
+        counts_(size_t(width) * height, 0) {}
+
+  int Width() const { return width_; }
+
+  int Height() const { return height_; }
+
+  int FirstSample() const { return first_sample_; }
+
+  int LastSample() const { return last_sample_; }
+
+  uint64_t Seed() const { return seed_; }
+
+  bool Empty() const { return sums_.empty(); }
+
+  void Set(size_t pixel, const color& sum, uint32_t count) {
+    sums_[pixel] = sum;
+    counts_[pixel] = count;
+  }
+
+  // Whether `other` can be added: a piece of the same frame size and seed whose samples
+  // directly follow or precede ours, so that the union stays one range without overlap.
+  bool Fits(const Accumulation& other) const {
+    return other.width_ == width_ && other.height_ == height_ && other.seed_ == seed_ &&
+           (other.first_sample_ == last_sample_ || other.last_sample_ == first_sample_);
+  }
+
+  // Add the samples of `other`; returns false, adding nothing, unless Fits(other).
+  bool Add(const Accumulation& other) {
+    if (!Fits(other))
+      return false;
+    first_sample_ = std::min(first_sample_, other.first_sample_);
+    last_sample_ = std::max(last_sample_, other.last_sample_);
+    for (size_t pixel = 0; pixel < sums_.size(); pixel++) {
+      sums_[pixel] += other.sums_[pixel];
+      counts_[pixel] += other.counts_[pixel];
+    }
+    return true;
+  }
+
+  // Mean sample color of a pixel, black if it has no samples.
+  color Pixel(size_t pixel) const {
+    return counts_[pixel] > 0 ? (1.0 / counts_[pixel]) * sums_[pixel] : color(0, 0, 0);
+  }
+
+  // Write the resolved image as a plain PPM image.
+  void WriteImage(std::ostream& out) const {
+    out << "P3\n" << width_ << ' ' << height_ << "\n255\n";
+    for (size_t pixel = 0; pixel < sums_.size(); pixel++)
+      write_color(out, Pixel(pixel));
+  }
+
+  void Write(std::ostream& out) const {
+    Header header;
+    header.width = uint32_t(width_);
+    header.height = uint32_t(height_);
+    header.first_sample = uint32_t(first_sample_);
+    header.last_sample = uint32_t(last_sample_);
+    header.seed = seed_;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<double> rgb;
+    rgb.reserve(sums_.size() * 3);
+    for (const auto& sum : sums_) {
+      rgb.push_back(sum.x());
+      rgb.push_back(sum.y());
+      rgb.push_back(sum.z());
+    }
+    out.write(reinterpret_cast<const char*>(rgb.data()),
+              std::streamsize(rgb.size() * sizeof(double)));
+    out.write(reinterpret_cast<const char*>(counts_.data()),
+              std::streamsize(counts_.size() * sizeof(uint32_t)));
+  }
+
+  // Returns false if `in` does not hold a complete accumulation.
+  bool Read(std::istream& in) {
+    Header header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::string(header.magic, 4) != std::string(kMagic, 4) ||
+        header.version != kVersion || header.first_sample > header.last_sample)
+      return false;
+
+    *this = Accumulation(int(header.width), int(header.height), int(header.first_sample),
+                         int(header.last_sample), header.seed);
+    std::vector<double> rgb(sums_.size() * 3);
+    in.read(reinterpret_cast<char*>(rgb.data()), std::streamsize(rgb.size() * sizeof(double)));
+    in.read(reinterpret_cast<char*>(counts_.data()),
+            std::streamsize(counts_.size() * sizeof(uint32_t)));
+    for (size_t pixel = 0; pixel < sums_.size(); pixel++)
+      sums_[pixel] = color(rgb[3 * pixel], rgb[3 * pixel + 1], rgb[3 * pixel + 2]);
+    return bool(in);
+  }
+
+private:
+  static constexpr char kMagic[4] = {'R', 'T', 'A', 'C'};
+  static const uint32_t kVersion = 2;
+
+  struct Header {
+    char magic[4] = {kMagic[0], kMagic[1], kMagic[2], kMagic[3]};
+    uint32_t version = kVersion;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t first_sample = 0;  // Sample range [first_sample, last_sample) of every pixel
+    uint32_t last_sample = 0;
+    uint64_t seed = 0;          // Camera::seed of the render
+  };
+
+private:
+  int width_ = 0;
+  int height_ = 0;
+  int first_sample_ = 0;
+  int last_sample_ = 0;
+  uint64_t seed_ = 0;
+  std::vector<color> sums_;
+  std::vector<uint32_t> counts_;
+};
@@ -1,15 +1,35 @@
 #pragma once
 
 #include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
+#include <numeric>
+#include <utility>
 #include <vector>
 #include "aabb.h"
+#include "arena.h"
 #include "common.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "interval.h"
 #include "ray.h"
+#include "scheduler.h"
+#include "stats.h"
+
+// Build the two subtrees of a BVH node, in parallel on the shared scheduler if the node is
+// large enough to pay for the task. The subtrees sort disjoint ranges of the object list.
+template <class Left, class Right>
+void BuildChildren(Left&& left, Right&& right, size_t object_span) {
+  const size_t kParallelSpan = 256;
+  if (object_span >= kParallelSpan && Scheduler::Shared().ThreadCount() > 1) {
+    Scheduler::Shared().Invoke(std::forward<Left>(left), std::forward<Right>(right));
+  } else {
+    left();
+    right();
+  }
+}
 
 class BvhNode : public Hittable {
 public:
@@ -45,14 +65,16 @@ public:
       std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
 
       auto mid = start + object_span / 2;
-      left_ = make_shared<BvhNode>(objects, start, mid);
-      right_ = make_shared<BvhNode>(objects, mid, end);
+      BuildChildren([&] { left_ = MakeShared<BvhNode>(objects, start, mid); },
+                    [&] { right_ = MakeShared<BvhNode>(objects, mid, end); }, object_span);
     }
 
     bbox_ = AABB(left_->BoundingBox(), right_->BoundingBox());
   }
 
   bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+    RT_STAT(bvh_nodes_visited);
+
     if (!bbox_.Hit(r, ray_t))
       return false;
 
@@ -62,8 +84,51 @@ public:
     return hit_left || hit_right;
   }
 
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    RT_STAT(bvh_nodes_visited);
+
+    if (!bbox_.Hit(r, ray_t))
+      return false;
+
+    return left_->Occluded(r, ray_t) || right_->Occluded(r, ray_t);
+  }
+
+  // Packet traversal in the style of ranged packet traversal (Overbeck et al., "Large Ray
+  // Packets for Real-Time Whitted Ray Tracing", 2008): an interval-arithmetic test culls the
+  // node for the whole packet, then the rays are tested one by one only until the first one
+  // that hits the box. That ray and all later active rays go on to the children; packets
+  // are coherent, so the later rays very likely hit too, and the primitives test them anyway.
+  void HitPacket(RayPacket& packet, uint32_t active) const override {
+    RT_STAT(bvh_nodes_visited);
+
+    if (!packet.MayHit(bbox_, active))
+      return;
+
+    for (; active != 0; active &= active - 1) {
+      int i = std::countr_zero(active);
+      if (bbox_.Hit(packet.rays[i], packet.t[i]))
+        break;
+    }
+    if (active == 0)
+      return;
+
+    left_->HitPacket(packet, active);
+    right_->HitPacket(packet, active);
+  }
+
   AABB BoundingBox() const override { return bbox_; }
 
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    info.bvh_nodes++;
+    for (const auto& child : {left_, right_}) {
+      if (!dynamic_cast<const BvhNode*>(child.get()))
+        info.CountBvhLeaf(bvh_depth + 1);
+      child->Describe(info, bvh_depth + 1);
+      if (left_ == right_)
+        break;  // Single-object node
+    }
+  }
+
 private:
   static bool BoxCompare(const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b,
                          int axis_index) {
@@ -89,3 +154,119 @@ private:
   shared_ptr<Hittable> left_;
   shared_ptr<Hittable> right_;
 };
+
+// BVH for scenes with moving objects. A BvhNode bounds the whole path of everything below it,
+// so nodes over fast movers overlap and rays visit most of them. A MotionBvhNode instead keeps
+// its bounds at the key times 0, 1/n, ..., 1 of its children's motion and culls with the box
+// interpolated at each ray's time, which is about as tight as a static BVH at that instant.
+// Children with different key times share the least common multiple of their segment counts;
+// past kMaxSegments, the node falls back to its swept box.
+class MotionBvhNode final : public Hittable {
+public:
+  MotionBvhNode(HittableList list) : MotionBvhNode(list.objects_, 0, list.objects_.size()) {}
+
+  MotionBvhNode(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end) {
+    size_t object_span = end - start;
+
+    if (object_span == 1) {
+      left_ = right_ = objects[start];
+    } else if (object_span == 2) {
+      left_ = objects[start];
+      right_ = objects[start + 1];
+    } else {
+      // Split at the median along the longest axis of the bounds halfway through the motion.
+      // The sort is stable, so of two coincident objects the one added first still wins ties,
+      // as in a HittableList.
+      AABB mid_bounds = AABB::empty;
+      for (size_t object_index = start; object_index < end; object_index++)
+        mid_bounds = AABB(mid_bounds, objects[object_index]->BoundingBoxAt(0.5));
+      int axis = mid_bounds.LongestAxis();
+
+      std::stable_sort(std::begin(objects) + start, std::begin(objects) + end,
+                       [axis](const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b) {
+                         return a->BoundingBoxAt(0.5).AxisInterval(axis).min <
+                                b->BoundingBoxAt(0.5).AxisInterval(axis).min;
+                       });
+
+      auto mid = start + object_span / 2;
+      BuildChildren([&] { left_ = MakeShared<MotionBvhNode>(objects, start, mid); },
+                    [&] { right_ = MakeShared<MotionBvhNode>(objects, mid, end); },
+                    object_span);
+    }
+
+    segments_ = std::lcm(left_->MotionSegments(), right_->MotionSegments());
+    if (segments_ > kMaxSegments) {
+      segments_ = 1;
+      start_ = end_ = AABB(left_->BoundingBox(), right_->BoundingBox());
+    } else {
+      start_ = AABB(left_->BoundingBoxAt(0), right_->BoundingBoxAt(0));
+      end_ = AABB(left_->BoundingBoxAt(1), right_->BoundingBoxAt(1));
+      for (int k = 1; k < segments_; k++) {
+        double time = double(k) / segments_;
+        inner_keys_.push_back(AABB(left_->BoundingBoxAt(time), right_->BoundingBoxAt(time)));
+      }
+    }
+  }
+
+  bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+    RT_STAT(bvh_nodes_visited);
+
+    if (!BoundingBoxAt(r.time()).Hit(r, ray_t))
+      return false;
+
+    bool hit_left = left_->Hit(r, ray_t, rec);
+    bool hit_right = right_->Hit(r, Interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+    return hit_left || hit_right;
+  }
+
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    RT_STAT(bvh_nodes_visited);
+
+    if (!BoundingBoxAt(r.time()).Hit(r, ray_t))
+      return false;
+
+    return left_->Occluded(r, ray_t) || right_->Occluded(r, ray_t);
+  }
+
+  // The interpolated boxes never leave the union of the key boxes.
+  AABB BoundingBox() const override {
+    AABB box(start_, end_);
+    for (const auto& key : inner_keys_)
+      box = AABB(box, key);
+    return box;
+  }
+
+  AABB BoundingBoxAt(double time) const override {
+    double segment = std::clamp(time, 0.0, 1.0) * segments_;
+    if (segments_ == 1)
+      return Lerp(start_, end_, segment);
+
+    int k = std::min(int(segment), segments_ - 1);
+    const AABB& from = k == 0 ? start_ : inner_keys_[k - 1];
+    const AABB& to = k + 1 == segments_ ? end_ : inner_keys_[k];
+    return Lerp(from, to, segment - k);
+  }
+
+  int MotionSegments() const override { return segments_; }
+
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    info.bvh_nodes++;
+    for (const auto& child : {left_, right_}) {
+      if (!dynamic_cast<const MotionBvhNode*>(child.get()))
+        info.CountBvhLeaf(bvh_depth + 1);
+      child->Describe(info, bvh_depth + 1);
+      if (left_ == right_)
+        break;  // Single-object node
+    }
+  }
+
+private:
+  static const int kMaxSegments = 16;
+
+  AABB start_, end_;              // Bounds at times 0 and 1
+  std::vector<AABB> inner_keys_;  // Bounds at the key times in between, 1/n to (n-1)/n
+  int segments_;                  // n
+  shared_ptr<Hittable> left_;
+  shared_ptr<Hittable> right_;
+};
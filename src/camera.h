@@ -1,45 +1,145 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include "accumulation.h"
 #include "color.h"
 #include "common.h"
 #include "hittable.h"
 #include "interval.h"
 #include "material.h" // IWYU pragma: keep
 #include "ray.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "stats.h"
 #include "timer.h"
 #include "vec3.h"
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 class Camera {
 // ----------------------------------------------------------------------------: methods
 public:
-  void Render(const Hittable& world) {
+  // Render the world into the frame buffer. The image is split into square tiles, which run
+  // as tasks on the shared scheduler, the most expensive ones first (see TileOrder). Every
+  // pixel reseeds the thread's random generator from (seed, pixel index), so the result
+  // depends neither on `threads` nor on the order of the tiles.
+  //
+  // `node_worlds[n]`, if given, is a copy of `world` in the memory of NUMA node n, and tiles
+  // trace the copy of the node their thread is pinned to (see BuildNodeReplicas).
+  void Render(const Hittable& world, const std::vector<const Hittable*>& node_worlds = {}) {
     Initialize();
 
-    std::cout << "P3\n" << image_width << ' ' << image_height_ << "\n255\n";
+    int tiles_x = (image_width + kTileSize - 1) / kTileSize;
+    int tiles_y = (image_height_ + kTileSize - 1) / kTileSize;
+    int tile_count = tiles_x * tiles_y;
 
+    Scheduler& scheduler = Scheduler::Shared(ThreadCount());
     Timer timer;
+    stats_ = RenderStats();
+    std::vector<int> order = TileOrder(world, scheduler, tiles_x, tile_count);
+
+    std::atomic<int> tiles_done = 0;
+    std::mutex stats_mutex;
+    tile_times_.assign(tile_count, 0.0);
+    auto calling_thread = std::this_thread::get_id();
+
+    scheduler.ParallelFor(tile_count, [&](int n) {
+      int tile = order[n];
+      const Hittable& local_world =
+          node_worlds.empty() ? world : *node_worlds[scheduler.CurrentNode()];
+      FlushDenormalsScope flush_denormals;
+      auto thread_sampler = MakeSampler(sampler, samples_per_pixel, seed);
+      SamplerScope sampler_scope(thread_sampler.get());
+      RT_STAT_TASK_BEGIN();
+
+      Timer tile_timer;
+      if (wavefront)
+        RenderTileWavefront(local_world, (tile % tiles_x) * kTileSize,
+                            (tile / tiles_x) * kTileSize);
+      else if (packets && max_depth > 0 && !per_sample_streams_)
+        RenderTilePackets(local_world, (tile % tiles_x) * kTileSize,
+                          (tile / tiles_x) * kTileSize);
+      else
+        RenderTile(local_world, (tile % tiles_x) * kTileSize, (tile / tiles_x) * kTileSize);
+      tile_times_[tile] = tile_timer.Elapsed();
+
+      RT_STAT_TASK_END(stats_, stats_mutex);
+      int remaining = tile_count - ++tiles_done;
+      if (std::this_thread::get_id() == calling_thread)  // The only thread printing
+        std::clog << "\rTiles remaining: " << remaining << ' ' << std::flush;
+    });
+
+    render_time_ = timer.Elapsed();
+    std::clog << "\rDone. Render time: " << render_time_ << "s (" << ThreadCount()
+              << " threads)\n";
+  }
+
+  // Sample sums and counts of the last rendered frame
+  const Accumulation& Accumulated() const { return accumulation_; }
+
+  // Write the last rendered frame as a plain PPM image.
+  void WriteImage(std::ostream& out) const {
+    out << "P3\n" << image_width << ' ' << image_height_ << "\n255\n";
+    for (const auto& pixel_color : image_)
+      write_color(out, pixel_color);
+  }
+
+  // Write the render time of every tile of the last frame as a false-color PPM image of the
+  // same size as the frame: blue for the fastest tile, red for the slowest.
+  void WriteHeatmap(std::ostream& out) const {
+    int tiles_x = (image_width + kTileSize - 1) / kTileSize;
+    auto [fastest, slowest] = std::minmax_element(tile_times_.begin(), tile_times_.end());
+    double range = std::max(*slowest - *fastest, 1e-9);
+
+    out << "P3\n" << image_width << ' ' << image_height_ << "\n255\n";
     for (int j = 0; j < image_height_; j++) {
-      std::clog << "\rScanline remaining: " << (image_height_ - j) << ' ' << std::flush;
       for (int i = 0; i < image_width; i++) {
-        color pixel_color(0,0,0);
-        for (int sample = 0; sample < samples_per_pixel; sample++) {
-          Ray r = GetRay(i, j);
-          pixel_color += RayColor(r, max_depth, world);
-        }
-        write_color(std::cout, pixel_samples_scale_ * pixel_color);
+        double time = tile_times_[(j / kTileSize) * tiles_x + i / kTileSize];
+        color c = HeatmapColor((time - *fastest) / range);
+        out << int(255.999 * c.x()) << ' ' << int(255.999 * c.y()) << ' '
+            << int(255.999 * c.z()) << '\n';
       }
     }
-    std::clog << "\rDone. Render time: " << timer.Elapsed() << "s\n";
   }
 
+  int ImageHeight() const { return image_height_; }
+
+  // Seconds spent on each tile of the last render, row by row
+  const std::vector<double>& TileTimes() const { return tile_times_; }
+
+  // Wall-clock seconds of the last Render call
+  double RenderTime() const { return render_time_; }
+
+  // Counters of the last Render call; all zero unless built with RAYTRACING_STATS.
+  const RenderStats& Stats() const { return stats_; }
+
+  int ThreadCount() const { return threads > 0 ? threads : Scheduler::HardwareThreads(); }
+
 private:
   void Initialize() {
     image_height_ = int(image_width / aspect_ratio);
     image_height_ = (image_height_ < 1) ? 1 : image_height_;
 
-    pixel_samples_scale_ = 1.0 / samples_per_pixel;
+    first_sample_ = sample_end < 0 ? 0 : std::clamp(sample_begin, 0, samples_per_pixel);
+    end_sample_ = sample_end < 0 ? samples_per_pixel : std::clamp(sample_end, first_sample_,
+                                                                  samples_per_pixel);
+    per_sample_streams_ = sample_end >= 0;
+    pixel_samples_scale_ = 1.0 / std::max(1, end_sample_ - first_sample_);
+
+    image_.assign(size_t(image_width) * image_height_, color(0, 0, 0));
+    accumulation_ = Accumulation(image_width, image_height_, first_sample_, end_sample_, seed);
 
     camera_center_ = lookfrom;
 
@@ -73,54 +173,401 @@ private:
     defocus_disk_v_ = up_ * defocus_radius;
   }
 
+  // Path throughput is a product of albedos, which in float underflows to denormals after a
+  // dozen dark bounces, and arithmetic on denormals is dozens of times slower. Flushes them
+  // to zero on the calling thread (FTZ and DAZ bits of MXCSR) while in scope, and restores
+  // the previous MXCSR after, so that threads leave a render in the mode they entered it.
+  class FlushDenormalsScope {
+  public:
+    FlushDenormalsScope() {
+#if defined(__SSE__)
+      saved_ = _mm_getcsr();
+      _mm_setcsr(saved_ | 0x8040);
+#endif
+    }
+
+    ~FlushDenormalsScope() {
+#if defined(__SSE__)
+      _mm_setcsr(saved_);
+#endif
+    }
+
+    FlushDenormalsScope(const FlushDenormalsScope&) = delete;
+    FlushDenormalsScope& operator=(const FlushDenormalsScope&) = delete;
+
+  private:
+    [[maybe_unused]] unsigned saved_ = 0;
+  };
+
+  // Tiles in the order to start them: by decreasing cost, as timed in the last render with
+  // the same tiles, or else estimated by timing a pilot path through each cell of a
+  // kPilotGrid^2 grid over every tile. Tiles through glass or smoke can cost many times what
+  // tiles of background do; started last, they would leave most threads idle at the end.
+  // Row order, and a single thread, for which the order does not matter, skip the pilot.
+  // Its paths are part of the render, in RenderTime() and in Stats() alike.
+  std::vector<int> TileOrder(const Hittable& world, Scheduler& scheduler, int tiles_x,
+                             int tile_count) {
+    std::vector<int> order(tile_count);
+    std::iota(order.begin(), order.end(), 0);
+    if (!costly_tiles_first || scheduler.ThreadCount() == 1)
+      return order;
+
+    std::vector<double> cost = tile_times_;
+    if (cost.size() != size_t(tile_count)) {
+      cost.assign(tile_count, 0.0);
+      std::mutex stats_mutex;
+      scheduler.ParallelFor(tile_count, [&](int tile) {
+        FlushDenormalsScope flush_denormals;
+        IndependentSampler pilot_sampler;
+        SamplerScope sampler_scope(&pilot_sampler);
+        RT_STAT_TASK_BEGIN();
+        Timer tile_timer;
+        for (int cell = 0; cell < kPilotGrid * kPilotGrid; cell++) {
+          const int step = kTileSize / kPilotGrid;
+          int i = std::min((tile % tiles_x) * kTileSize + (cell % kPilotGrid) * step + step / 2,
+                           image_width - 1);
+          int j = std::min((tile / tiles_x) * kTileSize + (cell / kPilotGrid) * step + step / 2,
+                           image_height_ - 1);
+          SeedRandom(~(seed ^ MixBits(size_t(j) * image_width + i)));
+          RayColor(GetRay(i, j), max_depth, world);
+        }
+        cost[tile] = tile_timer.Elapsed();
+        RT_STAT_TASK_END(stats_, stats_mutex);
+      });
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return cost[a] > cost[b]; });
+    return order;
+  }
+
+  void RenderTile(const Hittable& world, int x0, int y0) {
+    int x1 = std::min(x0 + kTileSize, image_width);
+    int y1 = std::min(y0 + kTileSize, image_height_);
+
+    for (int j = y0; j < y1; j++) {
+      for (int i = x0; i < x1; i++) {
+        size_t pixel = size_t(j) * image_width + i;
+        if (!per_sample_streams_)
+          SeedRandom(seed ^ MixBits(pixel));
+
+        color pixel_color(0, 0, 0);
+        for (int sample = first_sample_; sample < end_sample_; sample++) {
+          if (per_sample_streams_)
+            RandomGenerator() = SampleStream(pixel, sample);
+          ActiveSampler()->StartPixelSample(pixel, sample);
+          Ray r = GetRay(i, j);
+          pixel_color += RayColor(r, max_depth, world);
+        }
+        StorePixel(pixel, pixel_color);
+      }
+    }
+  }
+
+  // RenderTile with the camera rays of each kPacketSize x kPacketSize block of pixels traced
+  // together as a packet; the bounces after the first hit are traced one by one. Every pixel
+  // keeps its own random generator and sampler dimension across the split, so the image is
+  // identical to RenderTile's.
+  void RenderTilePackets(const Hittable& world, int x0, int y0) {
+    int x1 = std::min(x0 + kTileSize, image_width);
+    int y1 = std::min(y0 + kTileSize, image_height_);
+
+    for (int by = y0; by < y1; by += kPacketSize) {
+      for (int bx = x0; bx < x1; bx += kPacketSize) {
+        RayPacket packet;
+        int xs[RayPacket::kMaxRays], ys[RayPacket::kMaxRays];
+        color sums[RayPacket::kMaxRays];
+        for (int j = by; j < std::min(by + kPacketSize, y1); j++) {
+          for (int i = bx; i < std::min(bx + kPacketSize, x1); i++) {
+            int lane = packet.count++;
+            xs[lane] = i;
+            ys[lane] = j;
+            SeedRandom(seed ^ MixBits(size_t(j) * image_width + i));
+            packet.rng[lane] = RandomGenerator();
+          }
+        }
+
+        for (int sample = 0; sample < samples_per_pixel; sample++) {
+          int dimension = 0;
+          for (int lane = 0; lane < packet.count; lane++) {
+            RandomGenerator() = packet.rng[lane];
+            ActiveSampler()->StartPixelSample(size_t(ys[lane]) * image_width + xs[lane],
+                                              sample);
+            packet.rays[lane] = GetRay(xs[lane], ys[lane]);
+            packet.t[lane] = Interval(0, kInfinity);
+            packet.hit[lane] = false;
+            packet.rng[lane] = RandomGenerator();
+            dimension = ActiveSampler()->Dimension();
+          }
+
+          packet.Prepare();
+          world.HitPacket(packet, (1u << packet.count) - 1);
+          for (int lane = 0; lane < packet.count; lane++) {
+            if (packet.hit[lane])
+              packet.recs[lane].Finalize(packet.rays[lane]);
+          }
+
+          for (int lane = 0; lane < packet.count; lane++) {
+            RandomGenerator() = packet.rng[lane];
+            ActiveSampler()->StartPixelSample(size_t(ys[lane]) * image_width + xs[lane], sample,
+                                              dimension);
+            RT_STAT(camera_rays);
+            RT_STAT_DEPTH(ray_depth, 0);
+            if (packet.hit[lane]) {
+              sums[lane] += Shade(packet.rays[lane], packet.recs[lane], max_depth, world);
+            } else {
+              RT_STAT_DEPTH(path_depth, 0);
+              sums[lane] += background;
+            }
+            packet.rng[lane] = RandomGenerator();
+          }
+        }
+
+        for (int lane = 0; lane < packet.count; lane++)
+          StorePixel(size_t(ys[lane]) * image_width + xs[lane], sums[lane]);
+      }
+    }
+  }
+
+  // RenderTile as a wavefront renderer: the tile's paths advance in batches of
+  // kWavefrontBatch, one stage at a time over the whole batch instead of one path at a time.
+  // Each bounce intersects every live path, then shades the hits grouped by material type
+  // so each Scatter implementation runs over a run of paths, and drops finished paths from
+  // the queue after each stage. Every (pixel, sample) pair has its own random stream, so
+  // the image does not depend on the batch size, but it differs in noise from RenderTile's.
+  // With sort_rays, the bounce rays are sorted by direction octant and origin Morton code
+  // before they are intersected, so consecutive rays walk similar parts of the BVH.
+  void RenderTileWavefront(const Hittable& world, int x0, int y0) {
+    int x1 = std::min(x0 + kTileSize, image_width);
+    int y1 = std::min(y0 + kTileSize, image_height_);
+    int tile_width = x1 - x0;
+    int pixel_count = tile_width * (y1 - y0);
+    int path_count = pixel_count * (end_sample_ - first_sample_);
+
+    std::vector<color> sums(pixel_count, color(0, 0, 0));
+    std::vector<PathState> paths;
+    std::vector<int> queue;                            // Live paths, indices into `paths`
+    std::vector<std::pair<size_t, int>> by_material;  // (material type hash, path)
+    std::vector<std::pair<uint64_t, int>> by_ray;     // (RayKey, path)
+    AABB bounds = world.BoundingBox();
+
+    for (int first = 0; first < path_count; first += kWavefrontBatch) {
+      // Generate: the camera rays of the batch, sample-major so a batch spans the tile.
+      paths.resize(std::min(kWavefrontBatch, path_count - first));
+      queue.clear();
+      for (int n = 0; n < int(paths.size()); n++) {
+        PathState& path = paths[n];
+        int tile_pixel = (first + n) % pixel_count;
+        int i = x0 + tile_pixel % tile_width;
+        int j = y0 + tile_pixel / tile_width;
+        path.pixel = size_t(j) * image_width + i;
+        path.tile_pixel = tile_pixel;
+        path.sample = first_sample_ + (first + n) / pixel_count;
+        path.rng = SampleStream(path.pixel, path.sample);
+
+        RandomGenerator() = path.rng;
+        ActiveSampler()->StartPixelSample(path.pixel, path.sample);
+        path.ray = GetRay(i, j);
+        path.dimension = ActiveSampler()->Dimension();
+        path.rng = RandomGenerator();
+
+        path.throughput = color(1, 1, 1);
+        path.radiance = color(0, 0, 0);
+        path.depth = max_depth;
+        path.active = max_depth > 0;
+        if (path.active)
+          queue.push_back(n);
+        else
+          RT_STAT_DEPTH(path_depth, max_depth);
+      }
+
+      for (bool camera_rays = true; !queue.empty(); camera_rays = false) {
+        // Sort the bounce rays; camera rays are coherent already.
+        if (sort_rays && !camera_rays) {
+          by_ray.clear();
+          for (int n : queue)
+            by_ray.emplace_back(RayKey(paths[n].ray, bounds), n);
+          std::sort(by_ray.begin(), by_ray.end());
+          for (size_t k = 0; k < by_ray.size(); k++)
+            queue[k] = by_ray[k].second;
+        }
+
+        // Intersect
+        for (int n : queue) {
+          PathState& path = paths[n];
+          [[maybe_unused]] int bounce = max_depth - path.depth;
+          if (bounce == 0)
+            RT_STAT(camera_rays);
+          else
+            RT_STAT(secondary_rays);
+          RT_STAT_DEPTH(ray_depth, bounce);
+
+          RandomGenerator() = path.rng;  // Media draw random numbers in Hit
+          if (!world.Hit(path.ray, Interval(0, kInfinity), path.rec)) {
+            RT_STAT_DEPTH(path_depth, bounce);
+            path.radiance += path.throughput * background;
+            path.active = false;
+          } else {
+            path.rec.Finalize(path.ray);
+          }
+          path.rng = RandomGenerator();
+        }
+        std::erase_if(queue, [&](int n) { return !paths[n].active; });
+
+        // Shade, one material type after the other
+        by_material.clear();
+        for (int n : queue)
+          by_material.emplace_back(typeid(*paths[n].rec.mat).hash_code(), n);
+        std::sort(by_material.begin(), by_material.end());
+
+        for (auto [type, n] : by_material) {
+          PathState& path = paths[n];
+          [[maybe_unused]] int bounce = max_depth - path.depth;
+          RandomGenerator() = path.rng;
+          ActiveSampler()->StartPixelSample(path.pixel, path.sample, path.dimension);
+
+          const HitRecord& rec = path.rec;
+          Ray scattered;
+          color attenuation;
+          path.radiance += path.throughput * rec.mat->Emitted(rec.u, rec.v, rec.p);
+
+          RT_STAT(scatters);
+          if (!rec.mat->Scatter(path.ray, rec, attenuation, scattered)) {
+            RT_STAT_DEPTH(path_depth, bounce);
+            path.active = false;
+          } else if (--path.depth == 0) {
+            RT_STAT_DEPTH(path_depth, max_depth);
+            path.active = false;
+          } else {
+            vec3 leaving_normal =
+                dot(scattered.direction(), rec.normal) > 0 ? rec.normal : -rec.normal;
+            path.ray = Ray(offset_ray_origin(scattered.origin(), leaving_normal),
+                           scattered.direction(), scattered.time());
+            path.throughput = path.throughput * attenuation;
+          }
+
+          path.dimension = ActiveSampler()->Dimension();
+          path.rng = RandomGenerator();
+        }
+        std::erase_if(queue, [&](int n) { return !paths[n].active; });
+      }
+
+      for (const auto& path : paths)
+        sums[path.tile_pixel] += path.radiance;
+    }
+
+    for (int tile_pixel = 0; tile_pixel < pixel_count; tile_pixel++) {
+      int i = x0 + tile_pixel % tile_width;
+      int j = y0 + tile_pixel / tile_width;
+      StorePixel(size_t(j) * image_width + i, sums[tile_pixel]);
+    }
+  }
+
+  // Random stream of one sample of one pixel, for renders that must not depend on which
+  // other samples of the pixel are rendered: wavefront batches and sample ranges.
+  Pcg32 SampleStream(size_t pixel, int sample) const {
+    Pcg32 rng;
+    rng.Seed(MixBits(seed ^ MixBits(pixel)) ^ MixBits(sample + 1), uint64_t(sample));
+    return rng;
+  }
+
+  // Record the sum of the rendered samples of a pixel.
+  void StorePixel(size_t pixel, const color& sum) {
+    image_[pixel] = pixel_samples_scale_ * sum;
+    accumulation_.Set(pixel, sum, uint32_t(end_sample_ - first_sample_));
+  }
+
+  // Sort key of a ray: its direction octant above the 30-bit Morton code of its origin,
+  // quantized to 1024 steps per axis of the scene bounds.
+  static uint64_t RayKey(const Ray& r, const AABB& bounds) {
+    uint64_t key = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      if (r.direction()[axis] < 0)
+        key |= uint64_t(1) << (30 + axis);
+
+      const Interval& extent = bounds.AxisInterval(axis);
+      double offset = extent.Size() > 0 ? (r.origin()[axis] - extent.min) / extent.Size() : 0;
+      auto cell = uint64_t(std::clamp(offset * 1024, 0.0, 1023.0));
+      for (int bit = 0; bit < 10; bit++)
+        key |= ((cell >> bit) & 1) << (3 * bit + axis);
+    }
+    return key;
+  }
+
   Ray GetRay(int i, int j) const {
     // Construct a camera ray originating from the defocus disk and directed 
     // at randomly sampled point around the pixel location i, j
 
-    vec3 offset = SampleSquare();
+    // The first sampler dimensions: pixel jitter, lens position and time.
+    Point2 jitter = Sample2D();
+    Point2 lens = Sample2D();
+    double ray_time = Sample1D();
+
     vec3 pixel_sample = pixel00_loc_ + 
-                      ((i + offset.x()) * pixel_delta_u_) +
-                      ((j + offset.y()) * pixel_delta_v_);
-    point3 ray_origin = (defocus_angle <= 0) ? camera_center_ : DefocusDiskSample();
+                      ((i + jitter.x - 0.5) * pixel_delta_u_) +
+                      ((j + jitter.y - 0.5) * pixel_delta_v_);
+    point3 ray_origin = (defocus_angle <= 0) ? camera_center_ : DefocusDiskSample(lens);
     vec3 ray_direction = pixel_sample - ray_origin;
-    double ray_time = RandomDouble();
 
     return Ray(ray_origin, ray_direction, ray_time);
   }
 
-  // Retrun a random point int he camera defocus disk.
-  point3 DefocusDiskSample() const {
-    auto p = random_in_unit_disk();
+  // Return the point of the camera defocus disk that the unit-square sample u maps to.
+  point3 DefocusDiskSample(Point2 u) const {
+    auto p = sample_unit_disk(u.x, u.y);
     return camera_center_ + p[0] * defocus_disk_u_ + p[1] * defocus_disk_v_;
   }
 
   color RayColor(const Ray& r, int depth, const Hittable& world) const {
     // If we've exceeded the ray bounce limit, no more light is gathered
-    if (depth <= 0)
+    if (depth <= 0) {
+      RT_STAT_DEPTH(path_depth, max_depth);
       return color(0, 0, 0);
+    }
+
+    [[maybe_unused]] int bounce = max_depth - depth;
+    if (bounce == 0)
+      RT_STAT(camera_rays);
+    else
+      RT_STAT(secondary_rays);
+    RT_STAT_DEPTH(ray_depth, bounce);
 
     HitRecord rec;
 
     //  If the ray hits nothing, retur nthe background color
-    if (!world.Hit(r, Interval(0.001, kInfinity), rec))
+    if (!world.Hit(r, Interval(0, kInfinity), rec)) {
+      RT_STAT_DEPTH(path_depth, bounce);
       return background;
+    }
+    rec.Finalize(r);
 
+    return Shade(r, rec, depth, world);
+  }
+
+  // Light leaving the hit `rec` of ray `r` back along it: emission plus the scattered path.
+  color Shade(const Ray& r, const HitRecord& rec, int depth, const Hittable& world) const {
+    [[maybe_unused]] int bounce = max_depth - depth;
     Ray scattered;
     color attenuation;
     color color_from_emission = rec.mat->Emitted(rec.u, rec.v, rec.p);
 
-    if (!rec.mat->Scatter(r, rec, attenuation, scattered))
+    RT_STAT(scatters);
+    if (!rec.mat->Scatter(r, rec, attenuation, scattered)) {
+      RT_STAT_DEPTH(path_depth, bounce);
       return color_from_emission;
+    }
+
+    // Start the bounce just off the surface, on the side it leaves from. This replaces a
+    // fixed t-min of 0.001, which was too large for small objects and too small for float.
+    vec3 leaving_normal = dot(scattered.direction(), rec.normal) > 0 ? rec.normal : -rec.normal;
+    scattered = Ray(offset_ray_origin(scattered.origin(), leaving_normal),
+                    scattered.direction(), scattered.time());
 
     color color_from_scatter = attenuation * RayColor(scattered, depth - 1, world);
 
     return color_from_emission + color_from_scatter;
   }
 
-  // Returns the vector to a ramdom point in the [-0.5, -0.5]~[0.5, 0.5] unit squre.
-  vec3 SampleSquare() const  {
-    return vec3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0);
-  }
 
 // ----------------------------------------------------------------------------: data
 public:
@@ -137,10 +584,47 @@ public:
   double defocus_angle = 0;  // Variation angle of rays through each pixel
   double focus_dist = 10;  // Distance from camera lookfrom point to the plane of perfect focus
 
+  int threads = 0;        // Render threads, 0 = one per hardware thread
+  uint64_t seed = 0;      // Base of the per-pixel random seeds
+  SamplerType sampler = SamplerType::kIndependent;  // Pixel, lens, time and bounce samples
+  bool packets = false;   // Trace camera rays in packets of kPacketSize^2 neighbouring pixels
+  bool wavefront = false;  // Trace paths in batches, stage by stage (overrides packets)
+  bool sort_rays = false;  // Wavefront only: sort bounce rays before intersecting them
+  bool costly_tiles_first = true;  // Start tiles by decreasing cost instead of row by row
+
+  // Render only the samples [sample_begin, sample_end) of each pixel, a piece of a frame that
+  // can be merged with other pieces through Accumulated(). Every sample then has a random
+  // stream of its own, as in wavefront mode, so any split of the samples merges to the same
+  // frame; it differs in noise from a plain render. -1 = all samples, per-pixel streams.
+  int sample_begin = 0;
+  int sample_end = -1;
+
 private:
+  static const int kTileSize = 16;  // Tile edge in pixels, the unit of work for threads
+  static const int kPacketSize = 4;  // Packet edge in pixels; kPacketSize^2 <= kMaxRays
+  static const int kWavefrontBatch = 4096;  // Paths in flight per wavefront worker
+  static const int kPilotGrid = 4;  // Pilot paths per tile edge when estimating tile costs
+
+  // One path of the wavefront renderer between stages
+  struct PathState {
+    Ray ray;           // Next ray to trace
+    HitRecord rec;     // Hit of `ray`, between the intersect and shade stages
+    color throughput;  // Product of the attenuations along the path so far
+    color radiance;    // Light gathered so far, already scaled by the throughput
+    size_t pixel;      // Image pixel index
+    int tile_pixel;    // Pixel index within the tile
+    int sample;        // Sample index within the pixel
+    int depth;         // Bounces left
+    int dimension;     // Next sampler dimension
+    Pcg32 rng;         // Random stream of this (pixel, sample)
+    bool active;       // Still in the queue
+  };
+
   // Calculate the image height, and ensure that it's at least 1.
   int image_height_;            // Rendered iamge height
   double pixel_samples_scale_;  // Color scale factor for a sum of pixel samples
+  int first_sample_, end_sample_;  // Sample range rendered of each pixel
+  bool per_sample_streams_;     // Whether each sample seeds its own random stream
   point3 camera_center_;        // Camera center
   point3 pixel00_loc_;          // Location of pixel 0, 0 (upper left)
   vec3 pixel_delta_u_;          // Offset to pixel to the right
@@ -148,4 +632,9 @@ private:
   vec3 right_, up_, forward_;   // Camera frame basis vectors
   vec3 defocus_disk_u_;         // Defocus disk horizontal radius;
   vec3 defocus_disk_v_;         // Defocus disk vertical radius;
+  std::vector<color> image_;    // Averaged pixel colors of the last render, row by row
+  Accumulation accumulation_;   // Sample sums and counts of the last render
+  std::vector<double> tile_times_;  // Seconds per tile of the last render, row by row
+  double render_time_ = 0;      // Seconds spent in the last render
+  RenderStats stats_;           // Counters merged from all workers of the last render
 };
@@ -1,55 +1,77 @@
 #pragma once
 
 #include "aabb.h"
+#include "arena.h"
 #include "common.h"
 #include "hittable.h"
 #include "material.h"
+#include "stats.h"
 #include "texture.h"
 
 class ConstantMedium : public Hittable {
 public:
   ConstantMedium(shared_ptr<Hittable> boundary, double density, shared_ptr<Texture> tex)
       : boundary(boundary),
+        convex_boundary(boundary->IsConvex()),
         neg_inv_density(-1 / density),
-        phase_function(make_shared<Isotropic>(tex)) {}
+        phase_function(MakeShared<Isotropic>(tex)) {}
 
   ConstantMedium(shared_ptr<Hittable> boundary, double density, const color& albedo)
       : boundary(boundary),
+        convex_boundary(boundary->IsConvex()),
         neg_inv_density(-1 / density),
-        phase_function(make_shared<Isotropic>(albedo)) {}
+        phase_function(MakeShared<Isotropic>(albedo)) {}
 
   bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
-    HitRecord rec1, rec2;
+    RT_STAT(primitive_tests[kStatConstantMedium]);
 
-    if (!boundary->Hit(r, Interval::universe, rec1))
-      return false;
+    Interval inside;  // Where the ray line is inside the boundary
 
-    if (!boundary->Hit(r, Interval(rec1.t + 0.0001, kInfinity), rec2))
-      return false;
+    if (convex_boundary) {
+      // Both crossings from one analytic query (sphere, box, or a transformed copy).
+      if (!boundary->Span(r, inside))
+        return false;
+    } else {
+      // Rays that miss the boundary's box within ray_t can never scatter in here.
+      if (!boundary->BoundingBox().Hit(r, ray_t))
+        return false;
+
+      HitRecord rec1, rec2;
+
+      if (!boundary->Hit(r, Interval::universe, rec1))
+        return false;
 
-    if (rec1.t < ray_t.min)
-      rec1.t = ray_t.min;
-    if (rec2.t > ray_t.max)
-      rec2.t = ray_t.max;
+      if (!boundary->Hit(r, Interval(rec1.t + 0.0001, kInfinity), rec2))
+        return false;
 
-    if (rec1.t >= rec2.t)
+      inside = Interval(rec1.t, rec2.t);
+    }
+
+    // Clip to ray_t before drawing any random numbers.
+    if (inside.min < ray_t.min)
+      inside.min = ray_t.min;
+    if (inside.max > ray_t.max)
+      inside.max = ray_t.max;
+
+    if (inside.min >= inside.max)
       return false;
 
-    if (rec1.t < 0)
-      rec1.t = 0;
+    if (inside.min < 0)
+      inside.min = 0;
 
     auto ray_length = r.direction().length();
-    auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
+    auto distance_inside_boundary = (inside.max - inside.min) * ray_length;
     auto hit_distance = neg_inv_density * std::log(RandomDouble());
 
     if (hit_distance > distance_inside_boundary)
       return false;
 
-    rec.t = rec1.t + hit_distance / ray_length;
+    rec.t = inside.min + hit_distance / ray_length;
     rec.p = r.at(rec.t);
 
     rec.normal = vec3(1, 0, 0);  // arbitrary
     rec.front_face = true;       // also arbitrary
+    rec.object = nullptr;        // complete already
     rec.mat = phase_function;
 
     return true;
@@ -57,8 +79,13 @@ public:
 
   AABB BoundingBox() const override { return boundary->BoundingBox(); }
 
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    info.CountPrimitive("constant medium");
+  }
+
 private:
   shared_ptr<Hittable> boundary;
+  bool convex_boundary;
   double neg_inv_density;
   shared_ptr<Material> phase_function;
 };
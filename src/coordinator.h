@@ -0,0 +1,123 @@
+#pragma once
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "accumulation.h"
+
+extern char** environ;
+
+// Coordinator side of a frame split over worker processes. A worker is this program run with
+// the coordinator's command line plus `--worker --samples A:B`: it renders samples [A, B) of
+// every pixel and writes its Accumulation to stdout, which the coordinator reads through a
+// pipe. Every sample has its own random stream, so the workers' pieces are independent and
+// their sum is the frame of all the samples. Nothing in the exchange depends on the pipe,
+// which a socket to another machine could replace.
+class Coordinator {
+public:
+  // `args` is the worker command line, args[0] the program to run.
+  explicit Coordinator(std::vector<std::string> args) : args_(std::move(args)) {}
+
+  // Render samples [begin, end) of every pixel with `workers` processes of `threads` threads
+  // each and merge their pieces into `frame`. Returns false, after printing why, if a worker
+  // could not be started or did not deliver.
+  bool Render(int workers, int threads, int begin, int end, Accumulation& frame) {
+    std::vector<Worker> running;
+    for (int k = 0; k < workers; k++) {
+      int first = begin + int(int64_t(end - begin) * k / workers);
+      int last = begin + int(int64_t(end - begin) * (k + 1) / workers);
+      if (first == last)
+        continue;
+
+      std::vector<std::string> args = args_;
+      args.insert(args.end(), {"--worker", "--samples",
+                               std::to_string(first) + ":" + std::to_string(last),
+                               "--threads", std::to_string(threads)});
+      Worker worker;
+      if (!Start(args, worker)) {
+        std::cerr << "ERROR: Could not start worker '" << args[0] << "'.\n";
+        Finish(running, frame);
+        return false;
+      }
+      running.push_back(worker);
+    }
+    return Finish(running, frame);
+  }
+
+private:
+  // A worker process and the read end of its stdout
+  struct Worker {
+    pid_t pid = -1;
+    int fd = -1;
+  };
+
+  static bool Start(const std::vector<std::string>& args, Worker& worker) {
+    std::vector<char*> argv;
+    for (const auto& arg : args)
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    int fd[2];
+    if (pipe(fd) != 0)
+      return false;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fd[0]);
+    posix_spawn_file_actions_addclose(&actions, fd[1]);
+    int error = posix_spawnp(&worker.pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(fd[1]);
+    if (error != 0) {
+      close(fd[0]);
+      return false;
+    }
+    worker.fd = fd[0];
+    return true;
+  }
+
+  // Collect the pieces in worker order, so the merged sums do not depend on timing. A worker
+  // blocks once its piece fills the pipe, but only after it has finished rendering.
+  static bool Finish(const std::vector<Worker>& workers, Accumulation& frame) {
+    bool ok = true;
+    frame = Accumulation();
+    for (const auto& worker : workers) {
+      std::string data;
+      char buffer[1 << 16];
+      for (;;) {
+        ssize_t n = read(worker.fd, buffer, sizeof(buffer));
+        if (n > 0)
+          data.append(buffer, size_t(n));
+        else if (n == 0 || errno != EINTR)
+          break;
+      }
+      close(worker.fd);
+
+      int status = 0;
+      waitpid(worker.pid, &status, 0);
+      std::istringstream in(data);
+      Accumulation piece;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !piece.Read(in)) {
+        std::cerr << "ERROR: Worker " << worker.pid << " failed.\n";
+        ok = false;
+      } else if (frame.Empty()) {
+        frame = std::move(piece);
+      } else if (!frame.Add(piece)) {
+        std::cerr << "ERROR: Worker " << worker.pid << " rendered a piece of another frame.\n";
+        ok = false;
+      }
+    }
+    return ok && !frame.Empty();
+  }
+
+private:
+  std::vector<std::string> args_;
+};
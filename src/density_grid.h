@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "vec3.h"
+
+// A scalar voxel grid stored as 8x8x8 bricks. Bricks that contain only zeros are never
+// allocated, so sparse clouds and smoke only pay for their occupied regions.
+//
+// Text file formats accepted by `Load` (values are whitespace separated, '#' starts a
+// comment line):
+//
+//     dense nx ny nz              sparse nx ny nz
+//     v v v ... (x fastest)       i j k v
+//                                 i j k v ...
+class DensityGrid {
+public:
+  static const int kBrickSize = 8;
+
+  DensityGrid() {}
+
+  DensityGrid(int nx, int ny, int nz) : n_{nx, ny, nz} {
+    for (int axis = 0; axis < 3; axis++)
+      bricks_[axis] = (n_[axis] + kBrickSize - 1) / kBrickSize;
+    brick_offset_.assign(size_t(bricks_[0]) * bricks_[1] * bricks_[2], -1);
+  }
+
+  // Loads a grid from a text file. On failure prints an error and returns an empty grid.
+  static DensityGrid Load(const std::string& filename) {
+    std::ifstream in(filename);
+    if (!in) {
+      std::cerr << "ERROR: Could not load density grid '" << filename << "'.\n";
+      return DensityGrid();
+    }
+
+    SkipComments(in);
+    std::string kind;
+    int nx, ny, nz;
+    if (!(in >> kind >> nx >> ny >> nz) || nx <= 0 || ny <= 0 || nz <= 0 ||
+        (kind != "dense" && kind != "sparse")) {
+      std::cerr << "ERROR: Bad density grid header in '" << filename << "'.\n";
+      return DensityGrid();
+    }
+
+    DensityGrid grid(nx, ny, nz);
+    SkipComments(in);
+    if (kind == "dense") {
+      float value;
+      for (int k = 0; k < nz; k++)
+        for (int j = 0; j < ny; j++)
+          for (int i = 0; i < nx; i++) {
+            if (!(in >> value)) {
+              std::cerr << "ERROR: Truncated density grid '" << filename << "'.\n";
+              return DensityGrid();
+            }
+            grid.Set(i, j, k, value);
+          }
+    } else {
+      int i, j, k;
+      float value;
+      while (in >> i >> j >> k >> value)
+        grid.Set(i, j, k, value);
+    }
+    return grid;
+  }
+
+  bool Empty() const { return brick_offset_.empty(); }
+
+  int Size(int axis) const { return n_[axis]; }
+
+  int Bricks(int axis) const { return bricks_[axis]; }
+
+  size_t MemoryBytes() const {
+    return brick_data_.size() * sizeof(float) + brick_offset_.size() * sizeof(int32_t);
+  }
+
+  // Write one voxel. Writing zero into an unallocated brick does not allocate it.
+  void Set(int i, int j, int k, float value) {
+    if (!InRange(i, j, k))
+      return;
+
+    int32_t& offset = brick_offset_[BrickIndex(i / kBrickSize, j / kBrickSize, k / kBrickSize)];
+    if (offset < 0) {
+      if (value == 0)
+        return;
+      offset = int32_t(brick_data_.size());
+      brick_data_.resize(brick_data_.size() + kBrickVoxels, 0.0f);
+    }
+    brick_data_[offset + VoxelInBrick(i, j, k)] = value;
+  }
+
+  // Voxel value, zero outside the grid or in empty bricks.
+  float Voxel(int i, int j, int k) const {
+    if (!InRange(i, j, k))
+      return 0;
+
+    int32_t offset = brick_offset_[BrickIndex(i / kBrickSize, j / kBrickSize, k / kBrickSize)];
+    if (offset < 0)
+      return 0;
+    return brick_data_[offset + VoxelInBrick(i, j, k)];
+  }
+
+  // Trilinearly interpolated density at p, in voxel units: [0, nx] x [0, ny] x [0, nz],
+  // with voxel (i, j, k) centered at (i + 0.5, j + 0.5, k + 0.5).
+  double Lookup(const point3& p) const {
+    double x = p.x() - 0.5, y = p.y() - 0.5, z = p.z() - 0.5;
+    int i = int(std::floor(x)), j = int(std::floor(y)), k = int(std::floor(z));
+    double u = x - i, v = y - j, w = z - k;
+
+    auto accum = 0.0;
+    for (int di = 0; di < 2; di++)
+      for (int dj = 0; dj < 2; dj++)
+        for (int dk = 0; dk < 2; dk++) {
+          // clang-format off
+          accum += (di ? u : 1 - u) *
+                   (dj ? v : 1 - v) *
+                   (dk ? w : 1 - w) *
+                   Voxel(i + di, j + dj, k + dk);
+          // clang-format on
+        }
+    return accum;
+  }
+
+  // Upper bound of `Lookup` anywhere inside brick (bi, bj, bk). Trilinear filtering reaches
+  // one voxel past each brick face, so the footprint is widened accordingly.
+  float BrickMax(int bi, int bj, int bk) const {
+    int lo[3] = {bi * kBrickSize - 1, bj * kBrickSize - 1, bk * kBrickSize - 1};
+    float max = 0;
+    for (int k = lo[2]; k <= lo[2] + kBrickSize + 1; k++)
+      for (int j = lo[1]; j <= lo[1] + kBrickSize + 1; j++)
+        for (int i = lo[0]; i <= lo[0] + kBrickSize + 1; i++)
+          max = std::max(max, Voxel(i, j, k));
+    return max;
+  }
+
+private:
+  static const int kBrickVoxels = kBrickSize * kBrickSize * kBrickSize;
+
+  static void SkipComments(std::istream& in) {
+    while ((in >> std::ws).peek() == '#') {
+      std::string line;
+      std::getline(in, line);
+    }
+  }
+
+  bool InRange(int i, int j, int k) const {
+    return i >= 0 && j >= 0 && k >= 0 && i < n_[0] && j < n_[1] && k < n_[2];
+  }
+
+  size_t BrickIndex(int bi, int bj, int bk) const {
+    return (size_t(bk) * bricks_[1] + bj) * bricks_[0] + bi;
+  }
+
+  static int VoxelInBrick(int i, int j, int k) {
+    return ((k % kBrickSize) * kBrickSize + (j % kBrickSize)) * kBrickSize + (i % kBrickSize);
+  }
+
+private:
+  int n_[3] = {0, 0, 0};             // Voxels per axis
+  int bricks_[3] = {0, 0, 0};        // Bricks per axis
+  std::vector<int32_t> brick_offset_;  // Start of each brick in brick_data_, -1 if empty
+  std::vector<float> brick_data_;
+};
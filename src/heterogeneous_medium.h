@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "aabb.h"
+#include "arena.h"
+#include "common.h"
+#include "density_grid.h"
+#include "hittable.h"
+#include "material.h"
+#include "stats.h"
+#include "texture.h"
+
+// A participating medium whose density varies over a voxel grid stretched across `bounds`.
+//
+// Free-flight distances are sampled with delta tracking against a coarse majorant grid
+// (one cell per density brick). The ray walks the majorant cells with a 3D DDA; cells whose
+// majorant is zero are skipped without drawing any random numbers, and inside the other
+// cells the tentative collisions only need to beat the local, not the global, maximum.
+class HeterogeneousMedium : public Hittable {
+public:
+  HeterogeneousMedium(shared_ptr<DensityGrid> grid, const AABB& bounds, double density_scale,
+                      shared_ptr<Texture> tex)
+      : grid_(grid),
+        bounds_(bounds),
+        density_scale_(density_scale),
+        phase_function_(MakeShared<Isotropic>(tex)) {
+    BuildMajorants();
+  }
+
+  HeterogeneousMedium(shared_ptr<DensityGrid> grid, const AABB& bounds, double density_scale,
+                      const color& albedo)
+      : grid_(grid),
+        bounds_(bounds),
+        density_scale_(density_scale),
+        phase_function_(MakeShared<Isotropic>(albedo)) {
+    BuildMajorants();
+  }
+
+  bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+    RT_STAT(primitive_tests[kStatGridMedium]);
+
+    if (grid_->Empty() || !bounds_.Clip(r, ray_t))
+      return false;
+
+    double ray_length = r.direction().length();
+    bool scattered = false;
+    double t_hit = 0;
+
+    Traverse(r, ray_t, [&](double t0, double t1, double majorant) {
+      // Delta tracking inside one majorant cell. Thanks to the exponential distribution
+      // being memoryless, a flight that overshoots t1 simply restarts in the next cell.
+      double t = t0;
+      while (true) {
+        t -= std::log(1 - RandomDouble()) / (majorant * ray_length);
+        if (t >= t1)
+          return true;  // continue with the next cell
+
+        if (RandomDouble() * majorant < Density(r.at(t))) {
+          scattered = true;
+          t_hit = t;
+          return false;  // real collision, stop
+        }
+      }
+    });
+
+    if (!scattered)
+      return false;
+
+    rec.t = t_hit;
+    rec.p = r.at(rec.t);
+
+    rec.normal = vec3(1, 0, 0);  // arbitrary
+    rec.front_face = true;       // also arbitrary
+    rec.object = nullptr;        // complete already
+    rec.mat = phase_function_;
+
+    return true;
+  }
+
+  // Ratio-tracking estimate of the transmittance along ray_t, for visibility queries
+  // through the medium.
+  double Transmittance(const Ray& r, Interval ray_t) const {
+    if (grid_->Empty() || !bounds_.Clip(r, ray_t))
+      return 1;
+
+    double ray_length = r.direction().length();
+    double transmittance = 1;
+
+    Traverse(r, ray_t, [&](double t0, double t1, double majorant) {
+      double t = t0;
+      while (true) {
+        t -= std::log(1 - RandomDouble()) / (majorant * ray_length);
+        if (t >= t1)
+          return true;
+        transmittance *= 1 - Density(r.at(t)) / majorant;
+      }
+    });
+
+    return transmittance;
+  }
+
+  AABB BoundingBox() const override { return bounds_; }
+
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    info.CountPrimitive("grid medium");
+  }
+
+private:
+  // World-space point to grid voxel coordinates
+  point3 ToVoxel(const point3& p) const {
+    return point3((p.x() - bounds_.x.min) * voxels_per_unit_[0],
+                  (p.y() - bounds_.y.min) * voxels_per_unit_[1],
+                  (p.z() - bounds_.z.min) * voxels_per_unit_[2]);
+  }
+
+  double Density(const point3& p) const { return density_scale_ * grid_->Lookup(ToVoxel(p)); }
+
+  void BuildMajorants() {
+    for (int axis = 0; axis < 3; axis++) {
+      cells_[axis] = grid_->Bricks(axis);
+      voxels_per_unit_[axis] = grid_->Size(axis) / bounds_.AxisInterval(axis).Size();
+    }
+
+    majorant_.resize(size_t(cells_[0]) * cells_[1] * cells_[2]);
+    for (int k = 0; k < cells_[2]; k++)
+      for (int j = 0; j < cells_[1]; j++)
+        for (int i = 0; i < cells_[0]; i++)
+          majorant_[CellIndex(i, j, k)] = density_scale_ * grid_->BrickMax(i, j, k);
+  }
+
+  size_t CellIndex(int i, int j, int k) const {
+    return (size_t(k) * cells_[1] + j) * cells_[0] + i;
+  }
+
+  // Walk the majorant cells pierced by the ray over ray_t (already clipped to the bounds),
+  // calling visit(t0, t1, majorant) for every non-empty cell until it returns false.
+  template <typename Visit>
+  void Traverse(const Ray& r, const Interval& ray_t, Visit visit) const {
+    const double cell_size = DensityGrid::kBrickSize;
+
+    // Ray in majorant-cell coordinates; the ray parameter t is unchanged by the mapping.
+    point3 origin = ToVoxel(r.origin()) / cell_size;
+    vec3 dir(r.direction().x() * voxels_per_unit_[0] / cell_size,
+             r.direction().y() * voxels_per_unit_[1] / cell_size,
+             r.direction().z() * voxels_per_unit_[2] / cell_size);
+    point3 entry = origin + ray_t.min * dir;
+
+    int cell[3], step[3];
+    double t_next[3], t_delta[3];
+    for (int axis = 0; axis < 3; axis++) {
+      cell[axis] = int(std::floor(entry[axis]));
+      cell[axis] = std::max(0, std::min(cell[axis], cells_[axis] - 1));
+
+      if (dir[axis] > 0) {
+        step[axis] = 1;
+        t_delta[axis] = 1 / dir[axis];
+        t_next[axis] = ray_t.min + (cell[axis] + 1 - entry[axis]) * t_delta[axis];
+      } else if (dir[axis] < 0) {
+        step[axis] = -1;
+        t_delta[axis] = -1 / dir[axis];
+        t_next[axis] = ray_t.min + (entry[axis] - cell[axis]) * t_delta[axis];
+      } else {
+        step[axis] = 0;
+        t_delta[axis] = kInfinity;
+        t_next[axis] = kInfinity;
+      }
+    }
+
+    double t0 = ray_t.min;
+    while (true) {
+      int axis = (t_next[0] < t_next[1]) ? (t_next[0] < t_next[2] ? 0 : 2)
+                                         : (t_next[1] < t_next[2] ? 1 : 2);
+      double t1 = std::fmin(t_next[axis], ray_t.max);
+
+      double majorant = majorant_[CellIndex(cell[0], cell[1], cell[2])];
+      if (majorant > 0 && t1 > t0 && !visit(t0, t1, majorant))
+        return;
+
+      if (t_next[axis] >= ray_t.max)
+        return;
+
+      t0 = t1;
+      cell[axis] += step[axis];
+      if (cell[axis] < 0 || cell[axis] >= cells_[axis])
+        return;
+      t_next[axis] += t_delta[axis];
+    }
+  }
+
+private:
+  shared_ptr<DensityGrid> grid_;
+  AABB bounds_;
+  double density_scale_;
+  shared_ptr<Material> phase_function_;
+
+  int cells_[3];               // Majorant cells per axis (one per density brick)
+  double voxels_per_unit_[3];  // Grid resolution in voxels per world unit
+  std::vector<double> majorant_;
+};
@@ -1,14 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
 #include "aabb.h"
 #include "common.h"
 #include "interval.h"
 #include "ray.h"
 #include "vec3.h"
 
+class Hittable;
 class Material;
 
+// Hit of a ray with the scene. Primitives may defer everything but `t`: their Hit only sets
+// `t` and `object`, and the caller that owns the record calls Finalize once the closest hit
+// is known, which has `object` fill in the point, normal, UVs and material.
 class HitRecord {
 public:
   point3 p;  // hit point
@@ -18,6 +30,10 @@ public:
   vec3 normal;
   bool front_face;
   shared_ptr<Material> mat;
+  const Hittable* object = nullptr;  // Primitive to finalize the record, null once complete
+
+  // Fill in the deferred attributes of a hit of ray `r`.
+  void Finalize(const Ray& r);
 
   void SetFaceNormal(const Ray& r, const vec3& outward_normal) {
     // Sets the hit record normal vector.
@@ -27,15 +43,180 @@ public:
   }
 };
 
+// Up to kMaxRays coherent rays (camera rays of neighbouring pixels) traced together. Every
+// ray keeps its own interval, whose max shrinks to the closest hit found so far. Lanes are
+// selected by bit masks: bit i stands for rays[i].
+class RayPacket {
+public:
+  static const int kMaxRays = 16;
+
+  // Recompute the interval bounds of the packet; call after filling in the rays.
+  void Prepare() {
+    coherent_ = count > 0;
+    for (int axis = 0; axis < 3; axis++) {
+      origin_[axis] = inv_dir_[axis] = Interval::empty;
+      for (int i = 0; i < count; i++) {
+        real o = rays[i].origin()[axis];
+        real d = rays[i].direction()[axis];
+        origin_[axis] = Interval(origin_[axis], Interval(o, o));
+        inv_dir_[axis] = Interval(inv_dir_[axis], Interval(1 / d, 1 / d));
+        coherent_ = coherent_ && d != 0 && (d > 0) == (rays[0].direction()[axis] > 0);
+      }
+    }
+  }
+
+  // Conservative test of the whole packet against a box with interval arithmetic: false
+  // means that none of the `active` rays can hit it. Always true for packets whose
+  // directions do not share their signs.
+  bool MayHit(const AABB& box, uint32_t active) const {
+    if (!coherent_)
+      return true;
+
+    real t_min = kInfinity, t_max = -kInfinity;
+    for (uint32_t lanes = active; lanes != 0; lanes &= lanes - 1) {
+      int i = std::countr_zero(lanes);
+      t_min = std::min(t_min, t[i].min);
+      t_max = std::max(t_max, t[i].max);
+    }
+
+    // With all directions of one sign per axis, the rays enter through the same plane of
+    // each slab; bound the entry and exit distances over all origins and directions.
+    for (int axis = 0; axis < 3; axis++) {
+      const Interval& slab = box.AxisInterval(axis);
+      bool positive = inv_dir_[axis].min > 0;
+      real near = positive ? slab.min : slab.max;
+      real far = positive ? slab.max : slab.min;
+      t_min = std::max(t_min, ProductMin(near - origin_[axis].max, near - origin_[axis].min,
+                                         inv_dir_[axis]));
+      t_max = std::min(t_max, ProductMax(far - origin_[axis].max, far - origin_[axis].min,
+                                         inv_dir_[axis]));
+    }
+    return t_min <= t_max;
+  }
+
+private:
+  // Bounds of x * y over x in [lo, hi] and y in b
+  static real ProductMin(real lo, real hi, const Interval& b) {
+    return std::min(std::min(lo * b.min, lo * b.max), std::min(hi * b.min, hi * b.max));
+  }
+
+  static real ProductMax(real lo, real hi, const Interval& b) {
+    return std::max(std::max(lo * b.min, lo * b.max), std::max(hi * b.min, hi * b.max));
+  }
+
+public:
+  int count = 0;
+  Ray rays[kMaxRays];
+  Interval t[kMaxRays];
+  HitRecord recs[kMaxRays];
+  bool hit[kMaxRays] = {};
+  Pcg32 rng[kMaxRays];  // Random generator of each ray's path
+
+private:
+  bool coherent_ = false;  // Every axis has one direction sign for all rays
+  Interval origin_[3];     // Range of the ray origins per axis
+  Interval inv_dir_[3];    // Range of the inverse ray directions per axis
+};
+
+// Scene statistics gathered by Hittable::Describe, e.g. for a `--dry-run`. Objects that
+// are referenced several times (instances) are counted once per reference.
+class SceneInfo {
+public:
+  void CountPrimitive(const std::string& type) { primitives[type]++; }
+
+  void CountBvhLeaf(int depth) {
+    bvh_leaves++;
+    bvh_leaf_depth_sum += depth;
+    bvh_max_depth = std::max(bvh_max_depth, depth);
+  }
+
+  void Print(std::ostream& out) const {
+    int total = 0;
+    for (const auto& [type, count] : primitives) {
+      out << "  " << std::left << std::setw(18) << type << count << '\n';
+      total += count;
+    }
+    out << "  " << std::left << std::setw(18) << "total" << total << '\n';
+    out << "  instances         " << instances << '\n';
+    out << "  bvh nodes         " << bvh_nodes << '\n';
+    out << "  bvh leaves        " << bvh_leaves << '\n';
+    out << "  bvh max depth     " << bvh_max_depth << '\n';
+    if (bvh_leaves > 0)
+      out << "  bvh mean depth    " << double(bvh_leaf_depth_sum) / bvh_leaves << '\n';
+  }
+
+public:
+  std::map<std::string, int> primitives;  // Primitive count per type
+  int instances = 0;                      // Transform wrappers (Translate, RotateY)
+  int bvh_nodes = 0;
+  int bvh_leaves = 0;     // Children of BVH nodes that are not BVH nodes themselves
+  int bvh_max_depth = 0;
+  long bvh_leaf_depth_sum = 0;
+};
+
 class Hittable {
 public:
   virtual ~Hittable() = default;
 
   virtual bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const = 0;
 
+  // Complete a record whose Hit deferred the attributes (see HitRecord).
+  virtual void FinalizeHit(const Ray& r, HitRecord& rec) const {}
+
+  // Any-hit query for visibility: whether anything lies along `r` within `ray_t`. May stop
+  // at the first hit found and builds no hit record; overrides skip the shading work.
+  virtual bool Occluded(const Ray& r, Interval ray_t) const {
+    HitRecord rec;
+    return Hit(r, ray_t, rec);
+  }
+
+  // Intersect the `active` rays of a packet, updating their intervals, records and hit
+  // flags. Aggregates that can share work between the rays override this; everything else
+  // traces the rays one by one.
+  virtual void HitPacket(RayPacket& packet, uint32_t active) const {
+    Pcg32& generator = RandomGenerator();
+    for (uint32_t lanes = active; lanes != 0; lanes &= lanes - 1) {
+      int i = std::countr_zero(lanes);
+      // Media draw random numbers in Hit; each ray draws them from its own generator.
+      std::swap(generator, packet.rng[i]);
+      if (Hit(packet.rays[i], packet.t[i], packet.recs[i])) {
+        packet.hit[i] = true;
+        packet.t[i].max = packet.recs[i].t;
+      }
+      std::swap(generator, packet.rng[i]);
+    }
+  }
+
   virtual AABB BoundingBox() const = 0;
+
+  // Bounds at `time` in [0, 1], for motion BVHs. Between the MotionSegments() + 1 key times
+  // 0, 1/n, ..., 1, the object must move linearly, so that interpolating the key boxes
+  // bounds it. Defaults to the whole swept box, which trivially qualifies.
+  virtual AABB BoundingBoxAt(double time) const { return BoundingBox(); }
+
+  virtual int MotionSegments() const { return 1; }
+
+  // Add this object (and whatever it contains) to the statistics. `bvh_depth` is the number
+  // of BVH nodes above it.
+  virtual void Describe(SceneInfo& info, int bvh_depth) const { info.CountPrimitive("other"); }
+
+  // Convex solids (spheres, boxes and transformed copies of them) can report where a ray
+  // enters and leaves them in one analytic query, instead of two `Hit` calls.
+  virtual bool IsConvex() const { return false; }
+
+  // Set `span` to the parameter range of the whole ray line inside the solid; it may start
+  // behind the ray origin. Returns false on a miss. Only meaningful when IsConvex().
+  virtual bool Span(const Ray& r, Interval& span) const { return false; }
 };
 
+inline void HitRecord::Finalize(const Ray& r) {
+  if (object) {
+    const Hittable* deferred = object;
+    object = nullptr;
+    deferred->FinalizeHit(r, *this);
+  }
+}
+
 class Translate : public Hittable {
 public:
   Translate(shared_ptr<Hittable> object, const vec3& offset)
@@ -51,11 +232,29 @@ public:
     if (!object_->Hit(offset_r, ray_t, rec))
       return false;
 
+    // The child's attributes are in object space; finalize them before moving the point.
+    rec.Finalize(offset_r);
+
     // Move the intersection point forward by the offset
     rec.p += offset_;
     return true;
   }
 
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    return object_->Occluded(Ray(r.origin() - offset_, r.direction(), r.time()), ray_t);
+  }
+
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    info.instances++;
+    object_->Describe(info, bvh_depth);
+  }
+
+  bool IsConvex() const override { return object_->IsConvex(); }
+
+  bool Span(const Ray& r, Interval& span) const override {
+    return object_->Span(Ray(r.origin() - offset_, r.direction(), r.time()), span);
+  }
+
   AABB BoundingBox() const override { return bbox_; }
 
 private:
@@ -100,25 +299,15 @@ public:
 
   bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
     // Transform the ray from world space to object space
-    // clang-format off
-    auto origin = point3(
-      (cos_theta_ * r.origin().x()) - (sin_theta_ * r.origin().z()),
-      r.origin().y(),
-      (sin_theta_ * r.origin().x()) + (cos_theta_ * r.origin().z())
-    );
-    auto direction = vec3(
-      (cos_theta_ * r.direction().x()) - (sin_theta_ * r.direction().z()),
-      r.direction().y(),
-      (sin_theta_ * r.direction().x()) + (cos_theta_ * r.direction().z())
-    );
-
-    Ray rotate_r(origin, direction, r.time());
+    Ray rotate_r = ToObjectSpace(r);
 
     // Determin whether an intersection exists in object space (and if so, where)
     if (!object_->Hit(rotate_r, ray_t, rec))
       return false;
+    rec.Finalize(rotate_r);
 
     // Transform the intersection from object space back to world space.
+    // clang-format off
     rec.p = point3(
       (cos_theta_ * rec.p.x()) + (sin_theta_ * rec.p.z()),
       rec.p.y(),
@@ -135,8 +324,41 @@ public:
     return true;
   }
 
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    return object_->Occluded(ToObjectSpace(r), ray_t);
+  }
+
   AABB BoundingBox() const override { return bbox_; }
 
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    info.instances++;
+    object_->Describe(info, bvh_depth);
+  }
+
+  bool IsConvex() const override { return object_->IsConvex(); }
+
+  bool Span(const Ray& r, Interval& span) const override {
+    return object_->Span(ToObjectSpace(r), span);
+  }
+
+private:
+  Ray ToObjectSpace(const Ray& r) const {
+    // clang-format off
+    auto origin = point3(
+      (cos_theta_ * r.origin().x()) - (sin_theta_ * r.origin().z()),
+      r.origin().y(),
+      (sin_theta_ * r.origin().x()) + (cos_theta_ * r.origin().z())
+    );
+    auto direction = vec3(
+      (cos_theta_ * r.direction().x()) - (sin_theta_ * r.direction().z()),
+      r.direction().y(),
+      (sin_theta_ * r.direction().x()) + (cos_theta_ * r.direction().z())
+    );
+    // clang-format on
+
+    return Ray(origin, direction, r.time());
+  }
+
 private:
   shared_ptr<Hittable> object_;
   double sin_theta_;
@@ -35,8 +35,26 @@ public:
     return hit_anything;
   }
 
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    for (const auto& object : objects_) {
+      if (object->Occluded(r, ray_t))
+        return true;
+    }
+    return false;
+  }
+
+  void HitPacket(RayPacket& packet, uint32_t active) const override {
+    for (const auto& object : objects_)
+      object->HitPacket(packet, active);
+  }
+
   AABB BoundingBox() const override { return bbox_; }
 
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    for (const auto& object : objects_)
+      object->Describe(info, bvh_depth);
+  }
+
 public:
   std::vector<std::shared_ptr<Hittable>> objects_;
 
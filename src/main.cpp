@@ -1,443 +1,415 @@
-#include "bvh.h"
-#include "camera.h"
-#include "color.h"
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "arena.h"
 #include "common.h"
-#include "constant_medium.h"
+#include "coordinator.h"
 #include "hittable.h"
-#include "hittable_list.h"
-#include "material.h"
-#include "quad.h"
-#include "sphere.h"
-#include "texture.h"
-#include "vec3.h"
-
-// ----------------------------------------------------------------------------: scenes
-void BouncingSpheres() {
-  HittableList world;
-
-  auto checker = make_shared<CheckerTexture>(0.32, color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-  world.Add(make_shared<Sphere>(point3(0, -1000, 0), 1000, make_shared<Lambertian>(checker)));
-
-  auto ground_material = make_shared<Lambertian>(color(0.5, 0.5, 0.5));
-  world.Add(make_shared<Sphere>(point3(0, -1000, 0), 1000, ground_material));
-
-  for (int a = -11; a < 11; a++) {
-    for (int b = -11; b < 11; b++) {
-      auto choose_mat = RandomDouble();
-      point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
-
-      if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-        shared_ptr<Material> Sphere_material;
+#include "sampler.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "topology.h"
+
+// ----------------------------------------------------------------------------: options
+namespace {
+
+const char* kUsage = R"(usage: main [options] [scene]
+
+  scene               built-in scene name (see --list), or a .scene / .rtsb file
+                      (default: final-scene-preview)
+
+options:
+  --list              list the built-in scenes and exit
+  --width N           override the image width (the height follows the aspect ratio)
+  --spp N             override samples per pixel
+  --depth N           override the maximum ray depth
+  --threads N         threads for the scene build and render, 0 = one per hardware
+                      thread (default)
+  --seed N            random seed for scene construction and sampling (default 0)
+  --sampler NAME      independent (default), stratified (jittered pixel and lens strata)
+                      or sobol (Owen-scrambled Sobol points)
+  --packets           trace camera rays in 4x4 pixel packets (same image)
+  --wavefront         trace paths in batches, stage by stage, shading by material type
+  --sort-rays         with --wavefront, sort bounce rays by direction octant and origin
+  --no-arena          allocate the scene's objects one by one on the heap
+  --tiles-in-order    start tiles row by row instead of the most expensive first
+  --pin               pin each thread to a core, spread over the NUMA nodes
+  --replicate         give every NUMA node its own copy of the scene (implies --pin)
+  --samples A:B       render only samples A to B-1 of each pixel, each with a random
+                      stream of its own, so that pieces of a frame can be merged
+  --workers N         split the samples over N worker processes and merge their results
+  --worker            write the sample sums and counts to stdout instead of an image
+  --accumulation FILE write the sample sums and counts to FILE, for the merge tool; the
+                      image is then only written with -o
+  -o, --output FILE   write the PPM image to FILE instead of stdout
+  --heatmap FILE      also write a false-color PPM of the render time per tile to FILE
+  --dry-run           build the scene, print primitive counts and BVH statistics, exit
+  --compile FILE      write the compiled binary form of a scene file to FILE, exit
+)";
+
+struct Options {
+  std::string scene = "final-scene-preview";
+  std::optional<int> width, spp, depth, threads, workers;
+  std::optional<std::pair<int, int>> samples;  // [first, end)
+  uint64_t seed = 0;
+  SamplerType sampler = SamplerType::kIndependent;
+  std::string output;   // empty = stdout
+  std::string heatmap;  // empty = none
+  std::string compile;  // empty = render
+  std::string accumulation;  // empty = none
+  bool list = false;
+  bool dry_run = false;
+  bool packets = false;
+  bool wavefront = false;
+  bool sort_rays = false;
+  bool arena = true;
+  bool costly_tiles_first = true;
+  bool pin = false;
+  bool replicate = false;
+  bool worker = false;
+};
+
+bool ParseInt(const char* text, int min, int& value) {
+  char* end;
+  long v = std::strtol(text, &end, 10);
+  if (*text == '\0' || *end != '\0' || v < min || v > 1 << 30)
+    return false;
+  value = int(v);
+  return true;
+}
 
-        if (choose_mat < 0.8) {
-          // diffuse
-          auto albedo = color::random() * color::random();
-          Sphere_material = make_shared<Lambertian>(albedo);
-          auto center2 = center + vec3(0, RandomDouble(0, 0.5), 0);
-          world.Add(make_shared<Sphere>(center, center2, 0.2, Sphere_material));
-        } else if (choose_mat < 0.95) {
-          // metal
-          auto albedo = color::random(0.5, 1);
-          auto fuzz = RandomDouble(0, 0.5);
-          Sphere_material = make_shared<Metal>(albedo, fuzz);
-          world.Add(make_shared<Sphere>(center, 0.2, Sphere_material));
-        } else {
-          // glass
-          Sphere_material = make_shared<Dielectric>(1.5);
-          world.Add(make_shared<Sphere>(center, 0.2, Sphere_material));
-        }
+// Returns false (after printing why) if the command line is not valid.
+bool ParseOptions(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char* {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: " << arg << " expects a value\n";
+        return nullptr;
+      }
+      return argv[++i];
+    };
+    auto int_value = [&](int min, std::optional<int>& out) {
+      const char* text = value();
+      int v;
+      if (!text || !ParseInt(text, min, v)) {
+        if (text)
+          std::cerr << "ERROR: bad value for " << arg << ": '" << text << "'\n";
+        return false;
       }
+      out = v;
+      return true;
+    };
+
+    if (arg == "--list") {
+      opt.list = true;
+    } else if (arg == "--dry-run") {
+      opt.dry_run = true;
+    } else if (arg == "--width") {
+      if (!int_value(1, opt.width))
+        return false;
+    } else if (arg == "--spp") {
+      if (!int_value(1, opt.spp))
+        return false;
+    } else if (arg == "--depth") {
+      if (!int_value(1, opt.depth))
+        return false;
+    } else if (arg == "--threads") {
+      if (!int_value(0, opt.threads))
+        return false;
+    } else if (arg == "--seed") {
+      const char* text = value();
+      if (!text)
+        return false;
+      opt.seed = std::strtoull(text, nullptr, 0);
+    } else if (arg == "--sampler") {
+      const char* text = value();
+      if (!text)
+        return false;
+      if (!ParseSamplerType(text, opt.sampler)) {
+        std::cerr << "ERROR: unknown sampler '" << text << "'\n";
+        return false;
+      }
+    } else if (arg == "--packets") {
+      opt.packets = true;
+    } else if (arg == "--wavefront") {
+      opt.wavefront = true;
+    } else if (arg == "--sort-rays") {
+      opt.sort_rays = true;
+    } else if (arg == "--no-arena") {
+      opt.arena = false;
+    } else if (arg == "--tiles-in-order") {
+      opt.costly_tiles_first = false;
+    } else if (arg == "--pin") {
+      opt.pin = true;
+    } else if (arg == "--replicate") {
+      opt.replicate = opt.pin = true;
+    } else if (arg == "--samples") {
+      const char* text = value();
+      if (!text)
+        return false;
+      int first, end;
+      std::string range = text;
+      auto colon = range.find(':');
+      if (colon == std::string::npos || !ParseInt(range.substr(0, colon).c_str(), 0, first) ||
+          !ParseInt(range.substr(colon + 1).c_str(), first + 1, end)) {
+        std::cerr << "ERROR: bad value for " << arg << ": '" << text << "'\n";
+        return false;
+      }
+      opt.samples = {first, end};
+    } else if (arg == "--workers") {
+      if (!int_value(1, opt.workers))
+        return false;
+    } else if (arg == "--worker") {
+      opt.worker = true;
+    } else if (arg == "-o" || arg == "--output") {
+      const char* text = value();
+      if (!text)
+        return false;
+      opt.output = text;
+    } else if (arg == "--accumulation") {
+      const char* text = value();
+      if (!text)
+        return false;
+      opt.accumulation = text;
+    } else if (arg == "--heatmap") {
+      const char* text = value();
+      if (!text)
+        return false;
+      opt.heatmap = text;
+    } else if (arg == "--compile") {
+      const char* text = value();
+      if (!text)
+        return false;
+      opt.compile = text;
+    } else if (arg == "-h" || arg == "--help") {
+      std::cout << kUsage;
+      std::exit(0);
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "ERROR: unknown option '" << arg << "'\n";
+      return false;
+    } else {
+      opt.scene = arg;
     }
   }
-
-  auto material1 = make_shared<Dielectric>(1.5);
-  world.Add(make_shared<Sphere>(point3(0, 1, 0), 1.0, material1));
-
-  auto material2 = make_shared<Lambertian>(color(0.4, 0.2, 0.1));
-  world.Add(make_shared<Sphere>(point3(-4, 1, 0), 1.0, material2));
-
-  auto material3 = make_shared<Metal>(color(0.7, 0.6, 0.5), 0.0);
-  world.Add(make_shared<Sphere>(point3(4, 1, 0), 1.0, material3));
-
-  // world = HittableList(make_shared<BvhNode>(world));
-
-  Camera cam;
-
-  cam.aspect_ratio = 16.0 / 9.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0.70, 0.90, 1.00);
-
-  cam.vfov = 20;
-  cam.lookfrom = point3(13, 2, 3);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0.6;
-  cam.focus_dist = 10.0;
-
-  cam.Render(world);
-}
-
-void CheckeredSpheres() {
-  HittableList world;
-
-  auto checker = make_shared<CheckerTexture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-
-  world.Add(make_shared<Sphere>(point3(0, -10, 0), 10, make_shared<Lambertian>(checker)));
-  world.Add(make_shared<Sphere>(point3(0, 10, 0), 10, make_shared<Lambertian>(checker)));
-
-  world = HittableList(make_shared<BvhNode>(world));
-
-  Camera cam;
-  cam.aspect_ratio = 16.0 / 9.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0.70, 0.90, 1.00);
-
-  cam.vfov = 20;
-  cam.lookfrom = point3(13, 2, 3);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-  cam.Render(world);
-}
-
-void Earch() {
-  auto earth_texture = make_shared<ImageTexture>("earthmap.jpg");
-  auto earth_surface = make_shared<Lambertian>(earth_texture);
-  auto globe = make_shared<Sphere>(point3(0, 0, 0), 2, earth_surface);
-
-  Camera cam;
-
-  cam.aspect_ratio = 16.0 / 9.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0.70, 0.90, 1.00);
-
-  cam.vfov = 20;
-  cam.lookfrom = point3(0, 0, 12);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-
-  cam.Render(HittableList(globe));
-}
-
-void PerlinSphere() {
-  HittableList world;
-
-  auto pertext = make_shared<NoiseTexture>(4);
-  world.Add(make_shared<Sphere>(point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
-  world.Add(make_shared<Sphere>(point3(0, 2, 0), 2, make_shared<Lambertian>(pertext)));
-
-  Camera cam;
-
-  cam.aspect_ratio = 16.0 / 9.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0.70, 0.90, 1.00);
-
-  cam.vfov = 20;
-  cam.lookfrom = point3(12, 2, 3);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-
-  cam.Render(world);
-}
-
-void Quads() {
-  HittableList world;
-
-  // Materials
-  auto left_red = make_shared<Lambertian>(color(1.0, 0.2, 0.2));
-  auto back_green = make_shared<Lambertian>(color(0.2, 1.0, 0.2));
-  auto right_blue = make_shared<Lambertian>(color(0.2, 0.2, 1.0));
-  auto upper_orange = make_shared<Lambertian>(color(1.0, 0.5, 0.0));
-  auto lower_teal = make_shared<Lambertian>(color(0.2, 0.8, 0.8));
-
-  // Quads
-  world.Add(make_shared<Quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
-  world.Add(make_shared<Quad>(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
-  world.Add(make_shared<Quad>(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
-  world.Add(make_shared<Quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
-  world.Add(make_shared<Quad>(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal));
-
-  Camera cam;
-
-  cam.aspect_ratio = 1.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0.70, 0.90, 1.00);
-
-  cam.vfov = 80;
-  cam.lookfrom = point3(0, 0, 9);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-
-  cam.Render(world);
+  return true;
 }
 
-void EasterEggs() {
-  HittableList world;
-
-  // Materials
-  auto red = make_shared<Lambertian>(color(1.0, 0.2, 0.2));
-  auto green = make_shared<Lambertian>(color(0.2, 1.0, 0.2));
-  auto blue = make_shared<Lambertian>(color(0.2, 0.2, 1.0));
-  auto orange = make_shared<Lambertian>(color(1.0, 0.5, 0.0));
-  auto teal = make_shared<Lambertian>(color(0.2, 0.8, 0.8));
-
-  // Primitives: 2x2 grid layout
-  world.Add(make_shared<Quad>(point3(-2.0, 0.1, 0), vec3(1.8, 0, 0), vec3(0, 1.8, 0), red));
-  world.Add(
-      make_shared<Triangle>(point3(0.2, 0.1, 0), vec3(1.8, 0, 0), vec3(0, 1.8, 0), green));
-  world.Add(
-      make_shared<Ellipse>(point3(-1.1, -1.1, 0), vec3(0.9, 0, 0), vec3(0, 0.9, 0), blue));
-  world.Add(make_shared<Annulus>(point3(1.1, -1.1, 0), vec3(0.9, 0, 0), vec3(0, 0.9, 0), 0.5,
-                                 orange));
-
-  Camera cam;
-
-  cam.aspect_ratio = 1.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0.70, 0.90, 1.00);
-
-  cam.vfov = 20;
-  cam.lookfrom = point3(0, 0, 12);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-
-  cam.Render(world);
-}
-
-void SimpleLights() {
-  HittableList world;
-
-  auto pertext = make_shared<NoiseTexture>(4);
-  world.Add(make_shared<Sphere>(point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
-  world.Add(make_shared<Sphere>(point3(0, 2, 0), 2, make_shared<Lambertian>(pertext)));
-
-  auto difflight = make_shared<DiffuseLight>(color(4, 4, 4));
-  world.Add(make_shared<Sphere>(point3(0, 7, 0), 2, difflight));
-  world.Add(make_shared<Quad>(point3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), difflight));
-
-  Camera cam;
-
-  cam.aspect_ratio = 16.0 / 9.0;
-  cam.image_width = 400;
-  cam.samples_per_pixel = 100;
-  cam.max_depth = 50;
-  cam.background = color(0, 0, 0);
-
-  cam.vfov = 20;
-  cam.lookfrom = point3(26, 3, 6);
-  cam.lookat = point3(0, 2, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-
-  cam.Render(world);
+// Command line of the worker processes of --workers: this one without --workers.
+std::vector<std::string> WorkerCommand(int argc, char** argv) {
+  std::vector<std::string> args = {argv[0]};
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--workers")
+      i++;
+    else
+      args.push_back(argv[i]);
+  }
+  return args;
 }
 
-void CornelBox() {
-  HittableList world;
-
-  auto red = make_shared<Lambertian>(color(.65, .05, .05));
-  auto white = make_shared<Lambertian>(color(.73, .73, .73));
-  auto green = make_shared<Lambertian>(color(.12, .45, .15));
-  auto light = make_shared<DiffuseLight>(color(15, 15, 15));
-
-  // clang-format off
-  world.Add(make_shared<Quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
-  world.Add(make_shared<Quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
-  world.Add(make_shared<Quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
-  world.Add(make_shared<Quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-  world.Add(make_shared<Quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
-  world.Add(make_shared<Quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
-  // clang-format on
-
-  shared_ptr<Hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
-  box1 = make_shared<RotateY>(box1, 15);
-  box1 = make_shared<Translate>(box1, vec3(265, 0, 295));
-  world.Add(box1);
-
-  shared_ptr<Hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
-  box2 = make_shared<RotateY>(box2, -18);
-  box2 = make_shared<Translate>(box2, vec3(130, 0, 65));
-  world.Add(box2);
-
-  world = HittableList(make_shared<BvhNode>(world));
-
-  Camera cam;
-
-  cam.aspect_ratio = 1.0;
-  cam.image_width = 600;
-  cam.samples_per_pixel = 200;
-  cam.max_depth = 50;
-  cam.background = color(0, 0, 0);
-
-  cam.vfov = 40;
-  cam.lookfrom = point3(278, 278, -800);
-  cam.lookat = point3(278, 278, 0);
-  cam.vup = vec3(0, 1, 0);
+// Build the scene named on the command line: a built-in scene, or a scene file.
+bool LoadScene(const Options& opt, Scene& scene) {
+  if (auto entry = FindScene(opt.scene)) {
+    if (!opt.compile.empty()) {
+      std::cerr << "ERROR: --compile needs a scene file, '" << opt.scene << "' is built in\n";
+      return false;
+    }
+    scene = entry->build();
+    return true;
+  }
 
-  cam.defocus_angle = 0;
+  SceneFile file;
+  if (!file.Load(opt.scene))
+    return false;
+  if (!opt.compile.empty())
+    return file.SaveBinary(opt.compile);
 
-  cam.Render(world);
+  file.Build(scene);
+  return true;
 }
 
-void CornellSmoke() {
-  HittableList world;
-
-  auto red = make_shared<Lambertian>(color(.65, .05, .05));
-  auto white = make_shared<Lambertian>(color(.73, .73, .73));
-  auto green = make_shared<Lambertian>(color(.12, .45, .15));
-  auto light = make_shared<DiffuseLight>(color(7, 7, 7));
-
-  world.Add(make_shared<Quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
-  world.Add(make_shared<Quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
-  world.Add(make_shared<Quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light));
-  world.Add(make_shared<Quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-  world.Add(make_shared<Quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
-  world.Add(make_shared<Quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
-
-  shared_ptr<Hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
-  box1 = make_shared<RotateY>(box1, 15);
-  box1 = make_shared<Translate>(box1, vec3(265, 0, 295));
-
-  shared_ptr<Hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
-  box2 = make_shared<RotateY>(box2, -18);
-  box2 = make_shared<Translate>(box2, vec3(130, 0, 65));
-
-  world.Add(make_shared<ConstantMedium>(box1, 0.01, color(0, 0, 0)));
-  world.Add(make_shared<ConstantMedium>(box2, 0.01, color(1, 1, 1)));
-
-  Camera cam;
-
-  cam.aspect_ratio = 1.0;
-  cam.image_width = 600;
-  cam.samples_per_pixel = 200;
-  cam.max_depth = 50;
-  cam.background = color(0, 0, 0);
+}  // namespace
 
-  cam.vfov = 40;
-  cam.lookfrom = point3(278, 278, -800);
-  cam.lookat = point3(278, 278, 0);
-  cam.vup = vec3(0, 1, 0);
-
-  cam.defocus_angle = 0;
-
-  cam.Render(world);
-}
-
-void TheNextWeekFinalScene(int image_width, int samples_per_pixel, int max_depth) {
-  HittableList boxes1;
-  auto ground = make_shared<Lambertian>(color(0.48, 0.83, 0.53));
+// ----------------------------------------------------------------------------: main
+int main(int argc, char** argv) {
+  Options opt;
+  if (!ParseOptions(argc, argv, opt)) {
+    std::cerr << kUsage;
+    return 1;
+  }
 
-  int boxes_per_side = 20;
-  for (int i = 0; i < boxes_per_side; i++) {
-    for (int j = 0; j < boxes_per_side; j++) {
-      auto w = 100.0;
-      auto x0 = -1000.0 + i * w;
-      auto z0 = -1000.0 + j * w;
-      auto y0 = 0.0;
-      auto x1 = x0 + w;
-      auto y1 = RandomDouble(1, 101);
-      auto z1 = z0 + w;
+  if (opt.list) {
+    for (const auto& entry : BuiltinScenes())
+      std::cout << entry.name << '\n';
+    return 0;
+  }
 
-      boxes1.Add(box(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+  // stdout carries the samples of a worker, and its progress would garble the coordinator's.
+  if (opt.worker)
+    std::clog.rdbuf(nullptr);
+
+  // Scene construction draws random numbers too (sphere placement, Perlin tables).
+  SeedRandom(opt.seed);
+
+  // The BVH build and texture preprocessing run on the same threads as the render.
+  Scheduler::PinSharedThreads() = opt.pin;
+  Scheduler::Shared(opt.threads.value_or(0));
+
+  // Primitives, materials, textures and BVH nodes go into one arena, which is released with
+  // the last of them.
+  auto arena = opt.arena ? make_shared<Arena>() : nullptr;
+  Timer timer;
+  Scene scene;
+  {
+    ArenaScope arena_scope(arena);
+    if (!LoadScene(opt, scene))
+      return 1;
+  }
+  if (!opt.compile.empty())
+    return 0;
+  std::clog << "Scene built in " << timer.Elapsed() << "s";
+  if (arena)
+    std::clog << " (" << arena->BytesAllocated() / 1024 << " KiB in the arena)";
+  std::clog << '\n';
+
+  // Read-only copies of the scene for the other NUMA nodes, for threads pinned there.
+  std::vector<Scene> replicas;
+  std::vector<const Hittable*> node_worlds;
+  if (opt.replicate && !opt.dry_run && !opt.workers) {
+    timer.Reset();
+    replicas = BuildNodeReplicas([&](Scene& replica) { return LoadScene(opt, replica); },
+                                 opt.seed, opt.arena);
+    if (int(replicas.size()) + 1 != CpuTopology::Get().NodeCount()) {
+      std::cerr << "ERROR: Could not build the scene copy for NUMA node " << replicas.size() + 1
+                << ".\n";
+      return 1;
     }
+    node_worlds.push_back(&scene.world);
+    for (const auto& replica : replicas)
+      node_worlds.push_back(&replica.world);
+    std::clog << "Scene copies for " << node_worlds.size() << " NUMA node(s) built in "
+              << timer.Elapsed() << "s\n";
   }
 
-  HittableList world;
-
-  world.Add(make_shared<BvhNode>(boxes1));
-
-  auto light = make_shared<DiffuseLight>(color(7, 7, 7));
-  world.Add(make_shared<Quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), light));
-
-  auto center1 = point3(400, 400, 200);
-  auto center2 = center1 + vec3(30, 0, 0);
-  auto sphere_material = make_shared<Lambertian>(color(0.7, 0.3, 0.1));
-  world.Add(make_shared<Sphere>(center1, center2, 50, sphere_material));
-
-  world.Add(make_shared<Sphere>(point3(260, 150, 45), 50, make_shared<Dielectric>(1.5)));
-  world.Add(make_shared<Sphere>(point3(0, 150, 145), 50,
-                                make_shared<Metal>(color(0.8, 0.8, 0.9), 1.0)));
-
-  auto boundary = make_shared<Sphere>(point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
-  world.Add(boundary);
-  world.Add(make_shared<ConstantMedium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
-  boundary = make_shared<Sphere>(point3(0, 0, 0), 5000, make_shared<Dielectric>(1.5));
-  world.Add(make_shared<ConstantMedium>(boundary, .0001, color(1, 1, 1)));
-
-  auto emat = make_shared<Lambertian>(make_shared<ImageTexture>("earthmap.jpg"));
-  world.Add(make_shared<Sphere>(point3(400, 200, 400), 100, emat));
-  auto pertext = make_shared<NoiseTexture>(0.2);
-  world.Add(make_shared<Sphere>(point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
-
-  HittableList boxes2;
-  auto white = make_shared<Lambertian>(color(.73, .73, .73));
-  int ns = 1000;
-  for (int j = 0; j < ns; j++) {
-    boxes2.Add(make_shared<Sphere>(point3::random(0, 165), 10, white));
+  Camera& cam = scene.cam;
+  if (opt.width)
+    cam.image_width = *opt.width;
+  if (opt.spp)
+    cam.samples_per_pixel = *opt.spp;
+  if (opt.depth)
+    cam.max_depth = *opt.depth;
+  if (opt.threads)
+    cam.threads = *opt.threads;
+  cam.seed = opt.seed;
+  cam.sampler = opt.sampler;
+  cam.packets = opt.packets;
+  cam.wavefront = opt.wavefront;
+  cam.sort_rays = opt.sort_rays;
+  cam.costly_tiles_first = opt.costly_tiles_first;
+
+  if (opt.dry_run) {
+    SceneInfo info;
+    scene.world.Describe(info, 0);
+    std::cout << "scene: " << opt.scene << '\n'
+              << "  image             " << cam.image_width << " x "
+              << std::max(1, int(cam.image_width / cam.aspect_ratio)) << '\n'
+              << "  samples/pixel     " << cam.samples_per_pixel << '\n'
+              << "  max depth         " << cam.max_depth << '\n'
+              << "  threads           " << cam.ThreadCount() << '\n';
+    info.Print(std::cout);
+    return 0;
   }
 
-  world.Add(make_shared<Translate>(make_shared<RotateY>(make_shared<BvhNode>(boxes2), 15),
-                                   vec3(-100, 270, 395)));
+  // Pieces of a frame always render a sample range, so that they merge exactly.
+  int first_sample = opt.samples ? opt.samples->first : 0;
+  int end_sample = opt.samples ? opt.samples->second : cam.samples_per_pixel;
+  if (end_sample > cam.samples_per_pixel) {
+    std::cerr << "ERROR: --samples goes past the " << cam.samples_per_pixel
+              << " samples per pixel\n";
+    return 1;
+  }
+  if (opt.samples || opt.worker || !opt.accumulation.empty()) {
+    cam.sample_begin = first_sample;
+    cam.sample_end = end_sample;
+  }
 
-  Camera cam;
+  // Write a rendered Camera or a merged Accumulation as the output image, and the sample
+  // sums and counts for --accumulation.
+  auto write_output = [&](const auto& frame, const Accumulation& accumulation) {
+    if (!opt.accumulation.empty()) {
+      std::ofstream out(opt.accumulation, std::ios::binary);
+      accumulation.Write(out);
+      if (!out) {
+        std::cerr << "ERROR: Could not write accumulation '" << opt.accumulation << "'.\n";
+        return false;
+      }
+      if (opt.output.empty())
+        return true;
+    }
+    if (opt.output.empty()) {
+      frame.WriteImage(std::cout);
+      return true;
+    }
+    std::ofstream out(opt.output);
+    if (!out) {
+      std::cerr << "ERROR: Could not write image '" << opt.output << "'.\n";
+      return false;
+    }
+    frame.WriteImage(out);
+    return true;
+  };
+
+  if (opt.workers) {
+    if (!opt.heatmap.empty()) {
+      std::cerr << "ERROR: --heatmap needs a local render, not --workers\n";
+      return 1;
+    }
+    int threads = opt.threads ? *opt.threads
+                              : std::max(1, Scheduler::HardwareThreads() / *opt.workers);
+    timer.Reset();
+    Accumulation frame;
+    if (!Coordinator(WorkerCommand(argc, argv))
+             .Render(*opt.workers, threads, first_sample, end_sample, frame))
+      return 1;
+    std::clog << "Done. " << *opt.workers << " workers of " << threads << " threads rendered "
+              << "and merged in " << timer.Elapsed() << "s\n";
+    return write_output(frame, frame) ? 0 : 1;
+  }
 
-  cam.aspect_ratio = 1.0;
-  cam.image_width = image_width;
-  cam.samples_per_pixel = samples_per_pixel;
-  cam.max_depth = max_depth;
-  cam.background = color(0, 0, 0);
+  cam.Render(scene.world, node_worlds);
+#ifdef RAYTRACING_STATS
+  std::clog << "render statistics:\n";
+  cam.Stats().Print(std::clog);
+#endif
 
-  cam.vfov = 40;
-  cam.lookfrom = point3(478, 278, -600);
-  cam.lookat = point3(278, 278, 0);
-  cam.vup = vec3(0, 1, 0);
+  if (opt.worker) {
+    cam.Accumulated().Write(std::cout);
+    std::cout.flush();
+    return std::cout ? 0 : 1;
+  }
 
-  cam.defocus_angle = 0;
+  if (!write_output(cam, cam.Accumulated()))
+    return 1;
 
-  cam.Render(world);
-}
+  if (!opt.heatmap.empty()) {
+    std::ofstream out(opt.heatmap);
+    if (!out) {
+      std::cerr << "ERROR: Could not write heatmap '" << opt.heatmap << "'.\n";
+      return 1;
+    }
+    cam.WriteHeatmap(out);
 
-// ----------------------------------------------------------------------------: main
-int main() {
-  // clang-format off
-  switch (11) {
-    // case 1
-    // BVH on:  Render time: 52.8369s
-    // BVH off: Render time: 236.774s
-    case 1: BouncingSpheres(); break;
-    case 2: CheckeredSpheres(); break;
-    case 3: Earch(); break;
-    case 4: PerlinSphere(); break;
-    case 5: Quads(); break;
-    case 6: EasterEggs(); break;
-    case 7: SimpleLights(); break;
-    case 8: CornelBox(); break; // Render time: 311.929s
-    case 9: CornellSmoke(); break;
-    case 10: TheNextWeekFinalScene(800, 10000, 40); break; // sweet dreams
-    case 11: TheNextWeekFinalScene(400, 250, 4); break;
+    auto [fastest, slowest] =
+        std::minmax_element(cam.TileTimes().begin(), cam.TileTimes().end());
+    std::clog << "Tile times: " << *fastest << "s fastest, " << *slowest << "s slowest\n";
   }
-  // clang-format on
+  return 0;
 }
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <cmath>
+#include "arena.h"
 #include "color.h"
 #include "common.h"
 #include "hittable.h"
 #include "ray.h"
+#include "sampler.h"
 #include "texture.h"
 #include "vec3.h"
 
@@ -20,17 +22,22 @@ public:
   }
 
   virtual color Emitted(double u, double v, const point3& p) const { return color(0, 0, 0); }
+
+  // Whether Scatter or Emitted read the hit's texture coordinates. Primitives skip computing
+  // them for materials that don't.
+  virtual bool UsesUV() const { return true; }
 };
 
 class Lambertian : public Material {
 public:
-  Lambertian(const color& albedo) : texture_(make_shared<SolidColor>(albedo)) {}
+  Lambertian(const color& albedo) : texture_(MakeShared<SolidColor>(albedo)) {}
 
   Lambertian(shared_ptr<Texture> texture) : texture_(texture) {}
 
   bool Scatter(const Ray& r_in, const HitRecord& rec, color& attenuation,
                Ray& scattered) const override {
-    vec3 scatter_direction = rec.normal + random_unit_vector();
+    Point2 u = Sample2D();
+    vec3 scatter_direction = rec.normal + sample_unit_vector(u.x, u.y);
 
     // Catch degenrate scatter direction
     if (scatter_direction.near_zero())
@@ -41,6 +48,8 @@ public:
     return true;
   }
 
+  bool UsesUV() const override { return texture_->UsesUV(); }
+
 private:
   shared_ptr<Texture> texture_;
 };
@@ -52,12 +61,15 @@ public:
   bool Scatter(const Ray& r_in, const HitRecord& rec, color& attenuation,
                Ray& scattered) const override {
     vec3 reflected = reflect(r_in.direction(), rec.normal);
-    reflected = unit_vector(reflected) + (fuzz_ * random_unit_vector());
+    Point2 u = Sample2D();
+    reflected = unit_vector(reflected) + (fuzz_ * sample_unit_vector(u.x, u.y));
     scattered = Ray(rec.p, reflected, r_in.time());
     attenuation = albedo_;
     return (dot(scattered.direction(), rec.normal) > 0);
   }
 
+  bool UsesUV() const override { return false; }
+
 private:
   color albedo_;
   double fuzz_;
@@ -77,9 +89,10 @@ public:
     double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
 
     bool cannot_refract = ri * sin_theta > 1.0;
+    double u = Sample1D();  // Drawn even if unused, so later dimensions do not shift
     vec3 direction;
 
-    if (cannot_refract || Reflectance(cos_theta, ri) > RandomDouble())
+    if (cannot_refract || Reflectance(cos_theta, ri) > u)
       direction = reflect(unit_direction, rec.normal);
     else
       direction = refract(unit_direction, rec.normal, ri);
@@ -88,6 +101,8 @@ public:
     return true;
   }
 
+  bool UsesUV() const override { return false; }
+
 private:
   static double Reflectance(double cosine, double refraction_index) {
     // Use Schlick's approximation forreflectance.
@@ -106,29 +121,34 @@ class DiffuseLight : public Material {
 public:
   DiffuseLight(shared_ptr<Texture> texture) : texture_(texture) {}
 
-  DiffuseLight(const color& emit) : texture_(make_shared<SolidColor>(emit)) {}
+  DiffuseLight(const color& emit) : texture_(MakeShared<SolidColor>(emit)) {}
 
   color Emitted(double u, double v, const point3& p) const override {
     return texture_->Value(u, v, p);
   }
 
+  bool UsesUV() const override { return texture_->UsesUV(); }
+
 private:
   shared_ptr<Texture> texture_;
 };
 
 class Isotropic : public Material {
 public:
-  Isotropic(const color& albedo) : texture_(make_shared<SolidColor>(albedo)) {}
+  Isotropic(const color& albedo) : texture_(MakeShared<SolidColor>(albedo)) {}
 
   Isotropic(shared_ptr<Texture> texture) : texture_(texture) {}
 
   bool Scatter(const Ray& r_in, const HitRecord& rec, color& attenuation,
                Ray& scattered) const override {
-    scattered = Ray(rec.p, random_unit_vector(), r_in.time());
+    Point2 u = Sample2D();
+    scattered = Ray(rec.p, sample_unit_vector(u.x, u.y), r_in.time());
     attenuation = texture_->Value(rec.u, rec.v, rec.p);
     return true;
   }
 
+  bool UsesUV() const override { return texture_->UsesUV(); }
+
 private:
   shared_ptr<Texture> texture_;
 };
@@ -2,21 +2,25 @@
 
 #include <cmath>
 #include <functional>
+#include "arena.h"
 #include "common.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "interval.h"
 #include "material.h"
+#include "stats.h"
 #include "vec3.h"
 
 class Quad : public Hittable {
 public:
   Quad(const point3& origin, const vec3& u, const vec3& v, shared_ptr<Material> mat)
-      : origin_(origin), u_(u), v_(v), mat_(mat) {
+      : origin_(origin), u_(u), v_(v), mat_(mat), uses_uv_(!mat || mat->UsesUV()) {
     vec3 n = cross(u_, v_);
     normal_ = unit_vector(n);
     D_ = dot(normal_, origin_);
     w_ = n / dot(n, n);
+
+    SetBoundingBox();
   }
 
   // Compute the bounding box of all four vertices
@@ -29,54 +33,82 @@ public:
 
   AABB BoundingBox() const override { return bbox_; }
 
-  virtual bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
-    auto denom = dot(normal_, r.direction());  // denom 是分母项的意思
-
-    // No hit if the ray is parallel to the plane.
-    if (std::fabs(denom) < 1e-8)
-      return false;
-
-    // Return false if the hit point parameter t is outside the ray interval.
-    auto t = (D_ - dot(normal_, r.origin())) / denom;
-    if (!ray_t.Contains(t))
-      return false;
+  void Describe(SceneInfo& info, int bvh_depth) const override { info.CountPrimitive(Name()); }
 
-    // Determine if the hit point lies within the planar shape using its plane coordinates.
-    auto intersection = r.at(t);
-    vec3 planar_hitpt_vector = intersection - origin_;
-    auto alpha = dot(w_, cross(planar_hitpt_vector, v_));
-    auto beta = dot(w_, cross(u_, planar_hitpt_vector));
+  virtual bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+    RT_STAT(primitive_tests[kStatQuad]);
 
-    if (!IsInterior(alpha, beta, rec))
+    double t, alpha, beta;
+    if (!Intersect(r, ray_t, t, alpha, beta))
       return false;
 
-    // Ray hits the 2D shape; set the rest of the hit record and return true.
     rec.t = t;
-    rec.p = intersection;
+    rec.object = this;
+    return true;
+  }
+
+  void FinalizeHit(const Ray& r, HitRecord& rec) const override {
+    rec.p = r.at(rec.t);
     rec.mat = mat_;
     rec.SetFaceNormal(r, normal_);
+    if (uses_uv_) {
+      vec3 planar_hitpt_vector = rec.p - origin_;
+      PlaneUV(dot(w_, cross(planar_hitpt_vector, v_)), dot(w_, cross(u_, planar_hitpt_vector)),
+              rec.u, rec.v);
+    } else {
+      rec.u = rec.v = 0;
+    }
+  }
 
-    return true;
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    RT_STAT(primitive_tests[kStatQuad]);
+
+    double t, alpha, beta;
+    return Intersect(r, ray_t, t, alpha, beta);
   }
 
-  virtual bool IsInterior(double a, double b, HitRecord& rec) const {
+  // Given the hit point in plane coordinates, return whether it lies within the primitive.
+  virtual bool IsInterior(double a, double b) const {
     Interval unit_interval = Interval(0, 1);
-    // Given the hit point in plane coordinates, return false if it is outside the
-    // primitive, otherwise set the hit record UV coordinates and return true.
+    return unit_interval.Contains(a) && unit_interval.Contains(b);
+  }
+
+  // Texture coordinates of an interior point given in plane coordinates
+  virtual void PlaneUV(double a, double b, double& u, double& v) const {
+    u = a;
+    v = b;
+  }
+
+private:
+  // Ray parameter t and plane coordinates (alpha, beta) of the hit with the planar shape.
+  bool Intersect(const Ray& r, Interval ray_t, double& t, double& alpha, double& beta) const {
+    auto denom = dot(normal_, r.direction());  // denom 是分母项的意思
 
-    if (!unit_interval.Contains(a) || !unit_interval.Contains(b))
+    // No hit if the ray is parallel to the plane.
+    if (std::fabs(denom) < 1e-8)
       return false;
 
-    rec.u = a;
-    rec.v = b;
-    return true;
+    // Return false if the hit point parameter t is outside the ray interval.
+    t = (D_ - dot(normal_, r.origin())) / denom;
+    if (!ray_t.Contains(t))
+      return false;
+
+    // Determine if the hit point lies within the planar shape using its plane coordinates.
+    vec3 planar_hitpt_vector = r.at(t) - origin_;
+    alpha = dot(w_, cross(planar_hitpt_vector, v_));
+    beta = dot(w_, cross(u_, planar_hitpt_vector));
+    return IsInterior(alpha, beta);
   }
 
+protected:
+  virtual const char* Name() const { return "quad"; }
+
 protected:
   point3 origin_;
   vec3 u_, v_;
   vec3 w_;
   shared_ptr<Material> mat_;
+  bool uses_uv_;  // Whether the material reads texture coordinates
   AABB bbox_;
 
   vec3 normal_;
@@ -89,30 +121,29 @@ public:
   Triangle(const point3& o, const vec3& aa, const vec3& ab, shared_ptr<Material> mat)
       : Quad(o, aa, ab, mat) {}
 
-  virtual bool IsInterior(double a, double b, HitRecord& rec) const override {
-    if ((a < 0) || (b < 0) || (a + b > 1))
-      return false;
+  const char* Name() const override { return "triangle"; }
 
-    rec.u = a;
-    rec.v = b;
-    return true;
+  bool IsInterior(double a, double b) const override {
+    return (a >= 0) && (b >= 0) && (a + b <= 1);
   }
 };
 
 class Ellipse : public Quad {
 public:
   Ellipse(const point3& center, const vec3& u, const vec3& v, shared_ptr<Material> mat)
-      : Quad(center, u, v, mat) {}
+      : Quad(center, u, v, mat) {
+    SetBoundingBox();  // virtual calls in Quad's constructor don't reach this override
+  }
 
   void SetBoundingBox() override { bbox_ = AABB(origin_ - u_ - v_, origin_ + u_ + v_); }
 
-  bool IsInterior(double a, double b, HitRecord& rec) const override {
-    if ((a * a + b * b) > 1)
-      return false;
+  const char* Name() const override { return "ellipse"; }
 
-    rec.u = a / 2 + 0.5;
-    rec.v = b / 2 + 0.5;
-    return true;
+  bool IsInterior(double a, double b) const override { return (a * a + b * b) <= 1; }
+
+  void PlaneUV(double a, double b, double& u, double& v) const override {
+    u = a / 2 + 0.5;
+    v = b / 2 + 0.5;
   }
 };
 
@@ -121,18 +152,22 @@ class Annulus : public Quad {
 public:
   Annulus(const point3& center, const vec3& u, const vec3& v, double inner,
           shared_ptr<Material> mat)
-      : Quad(center, u, v, mat), inner_(inner) {}
+      : Quad(center, u, v, mat), inner_(inner) {
+    SetBoundingBox();
+  }
 
   void SetBoundingBox() override { bbox_ = AABB(origin_ - u_ - v_, origin_ + u_ + v_); }
 
-  bool IsInterior(double a, double b, HitRecord& rec) const override {
+  const char* Name() const override { return "annulus"; }
+
+  bool IsInterior(double a, double b) const override {
     auto center_dist = std::sqrt(a * a + b * b);
-    if ((center_dist < inner_) || (center_dist > 1))
-      return false;
+    return (center_dist >= inner_) && (center_dist <= 1);
+  }
 
-    rec.u = a / 2 + 0.5;
-    rec.v = b / 2 + 0.5;
-    return true;
+  void PlaneUV(double a, double b, double& u, double& v) const override {
+    u = a / 2 + 0.5;
+    v = b / 2 + 0.5;
   }
 
 private:
@@ -140,24 +175,41 @@ private:
 };
 
 // ----------------------------------------------------------------------------: box
-// Return the 3D box (six side) that contains the tow opposite vertices a & b
-inline shared_ptr<HittableList> box(const point3& a, const point3& b, shared_ptr<Material> mat) {
-  auto sides = make_shared<HittableList>();
+// An axis-aligned box made of six quads. It renders like any other HittableList, but also
+// knows it is convex, so volumes bounded by it can use a single slab test for both faces.
+class Box : public HittableList {
+public:
+  Box(const point3& min, const point3& max) : extent_(min, max) {}
+
+  bool IsConvex() const override { return true; }
 
+  bool Span(const Ray& r, Interval& span) const override {
+    span = Interval::universe;
+    return extent_.Clip(r, span);
+  }
+
+private:
+  AABB extent_;
+};
+
+// Return the 3D box (six side) that contains the tow opposite vertices a & b
+inline shared_ptr<Box> box(const point3& a, const point3& b, shared_ptr<Material> mat) {
   // Construct the two opposite vertices with the minimum and maximum coordinates
   auto min = point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
   auto max = point3(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z()));
 
+  auto sides = MakeShared<Box>(min, max);
+
   auto dx = vec3(max.x() - min.x(), 0, 0);
   auto dy = vec3(0, max.y() - min.y(), 0);
   auto dz = vec3(0, 0, max.z() - min.z());
 
-  sides->Add(make_shared<Quad>(point3(min.x(), min.y(), max.z()), dx, dy, mat));   // front
-  sides->Add(make_shared<Quad>(point3(max.x(), min.y(), max.z()), -dz, dy, mat));  // right
-  sides->Add(make_shared<Quad>(point3(max.x(), min.y(), min.z()), -dx, dy, mat));  // back
-  sides->Add(make_shared<Quad>(point3(min.x(), min.y(), min.z()), dz, dy, mat));   // left
-  sides->Add(make_shared<Quad>(point3(min.x(), max.y(), max.z()), dx, -dz, mat));  // top
-  sides->Add(make_shared<Quad>(point3(min.x(), min.y(), min.z()), dx, dz, mat));   // bottom
+  sides->Add(MakeShared<Quad>(point3(min.x(), min.y(), max.z()), dx, dy, mat));   // front
+  sides->Add(MakeShared<Quad>(point3(max.x(), min.y(), max.z()), -dz, dy, mat));  // right
+  sides->Add(MakeShared<Quad>(point3(max.x(), min.y(), min.z()), -dx, dy, mat));  // back
+  sides->Add(MakeShared<Quad>(point3(min.x(), min.y(), min.z()), dz, dy, mat));   // left
+  sides->Add(MakeShared<Quad>(point3(min.x(), max.y(), max.z()), dx, -dz, mat));  // top
+  sides->Add(MakeShared<Quad>(point3(min.x(), min.y(), min.z()), dx, dz, mat));   // bottom
 
   return sides;
 }
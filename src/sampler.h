@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "common.h"
+
+// Sample streams for the camera and the materials.
+//
+// Camera::RenderTile calls StartPixelSample before tracing each sample; after that, every
+// Get1D / Get2D call consumes the next dimension of that sample. The camera takes the pixel
+// jitter, lens and time dimensions first, then each bounce takes its own dimensions in path
+// order, so the same dimension always feeds the same decision. Code that draws a variable
+// number of values per bounce (free-flight sampling in media) keeps using RandomDouble, or
+// it would shift every later dimension.
+
+struct Point2 {
+  double x, y;
+};
+
+class Sampler {
+public:
+  virtual ~Sampler() = default;
+
+  // Begin sample `index` of `pixel` at `dimension`, normally zero. A nonzero dimension
+  // resumes a sample that was interrupted after Dimension() returned that value.
+  virtual void StartPixelSample(uint64_t pixel, int index, int dimension = 0) = 0;
+
+  // Dimension the next Get1D / Get2D call of the current sample consumes.
+  virtual int Dimension() const = 0;
+
+  virtual double Get1D() = 0;
+
+  virtual Point2 Get2D() = 0;
+};
+
+// Independent uniform random numbers from the thread's generator: plain Monte Carlo.
+class IndependentSampler : public Sampler {
+public:
+  void StartPixelSample(uint64_t pixel, int index, int dimension) override {}
+
+  int Dimension() const override { return 0; }
+
+  double Get1D() override { return RandomDouble(); }
+
+  Point2 Get2D() override { return {RandomDouble(), RandomDouble()}; }
+};
+
+// Owen-scrambled Sobol points, padded in 2D (Burley, "Practical Hash-based Owen Scrambling",
+// JCGT 2020). Each pair of dimensions uses the first two Sobol dimensions, which are
+// well stratified together, with the sample index shuffled and the bits scrambled by hashes
+// of (pixel, dimension). Pairs are therefore decorrelated from each other and from
+// neighbouring pixels. Works for any sample count, best for powers of two.
+class SobolSampler : public Sampler {
+public:
+  explicit SobolSampler(uint64_t seed) : seed_(seed) {}
+
+  void StartPixelSample(uint64_t pixel, int index, int dimension) override {
+    pixel_seed_ = MixBits(seed_ ^ MixBits(pixel));
+    index_ = uint32_t(index);
+    dimension_ = uint32_t(dimension);
+  }
+
+  int Dimension() const override { return int(dimension_); }
+
+  double Get1D() override {
+    uint32_t hash = DimensionHash();
+    uint32_t shuffled = NestedUniformScramble(index_, Hash(hash, 0));
+    return ToUnit(NestedUniformScramble(ReverseBits(shuffled), Hash(hash, 1)));
+  }
+
+  Point2 Get2D() override {
+    uint32_t hash = DimensionHash();
+    uint32_t shuffled = NestedUniformScramble(index_, Hash(hash, 0));
+    return {ToUnit(NestedUniformScramble(ReverseBits(shuffled), Hash(hash, 1))),
+            ToUnit(NestedUniformScramble(SobolDimension1(shuffled), Hash(hash, 2)))};
+  }
+
+private:
+  uint32_t DimensionHash() { return uint32_t(MixBits(pixel_seed_ + dimension_++)); }
+
+  static uint32_t Hash(uint32_t value, uint32_t salt) {
+    return uint32_t(MixBits((uint64_t(salt) << 32) | value));
+  }
+
+  static double ToUnit(uint32_t bits) { return bits * 0x1p-32; }
+
+  static uint32_t ReverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+  }
+
+  // Second Sobol dimension; the first is ReverseBits (van der Corput).
+  static uint32_t SobolDimension1(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+      if (index & 1)
+        result ^= v;
+    return result;
+  }
+
+  // Hash that only lets bits propagate upwards, i.e. a random permutation that preserves
+  // the binary stratification of x's low bits (Laine and Karras, improved constants).
+  static uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+  }
+
+  // Owen scrambling of the binary fraction 0.x: flips each bit based on the bits above it.
+  static uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) {
+    return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+  }
+
+private:
+  uint64_t seed_;
+  uint64_t pixel_seed_ = 0;
+  uint32_t index_ = 0;
+  uint32_t dimension_ = 0;
+};
+
+// Jittered sqrt(spp) x sqrt(spp) strata for the pixel and lens dimensions (the first two 2D
+// dimensions), independent random numbers for everything else. Every sample of a pixel
+// lands in its own stratum of the pixel square and of the lens disk; the lens strata are
+// visited in a per-pixel random order, so pixel and lens positions are not correlated.
+// Samples past the largest square count (e.g. 5 of 9 + 5 = 14 spp) are plain random.
+class StratifiedSampler : public Sampler {
+public:
+  StratifiedSampler(int samples_per_pixel, uint64_t seed)
+      : strata_(int(std::sqrt(double(samples_per_pixel)))), seed_(seed) {}
+
+  void StartPixelSample(uint64_t pixel, int index, int dimension) override {
+    pixel_seed_ = uint32_t(MixBits(seed_ ^ MixBits(pixel)));
+    index_ = index;
+    dimension_ = dimension;
+  }
+
+  int Dimension() const override { return dimension_; }
+
+  double Get1D() override { return RandomDouble(); }
+
+  Point2 Get2D() override {
+    int dimension = dimension_++;
+    int count = strata_ * strata_;
+    if (dimension >= 2 || index_ >= count)
+      return {RandomDouble(), RandomDouble()};
+
+    int stratum = Permute(uint32_t(index_), uint32_t(count), pixel_seed_ + dimension);
+    return {(stratum % strata_ + RandomDouble()) / strata_,
+            (stratum / strata_ + RandomDouble()) / strata_};
+  }
+
+private:
+  // Element i of a random permutation of [0, length) chosen by `seed`, without a table
+  // (Kensler, "Correlated Multi-Jittered Sampling", 2013).
+  static int Permute(uint32_t i, uint32_t length, uint32_t seed) {
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+      i ^= seed;
+      i *= 0xe170893d;
+      i ^= seed >> 16;
+      i ^= (i & w) >> 4;
+      i ^= seed >> 8;
+      i *= 0x0929eb3f;
+      i ^= seed >> 23;
+      i ^= (i & w) >> 1;
+      i *= 1 | seed >> 27;
+      i *= 0x6935fa69;
+      i ^= (i & w) >> 11;
+      i *= 0x74dcb303;
+      i ^= (i & w) >> 2;
+      i *= 0x9e501cc3;
+      i ^= (i & w) >> 2;
+      i *= 0xc860a3df;
+      i &= w;
+      i ^= i >> 5;
+    } while (i >= length);
+    return int((i + seed) % length);
+  }
+
+private:
+  int strata_;  // Strata per axis
+  uint64_t seed_;
+  uint32_t pixel_seed_ = 0;
+  int index_ = 0;
+  int dimension_ = 0;
+};
+
+enum class SamplerType { kIndependent, kStratified, kSobol };
+
+inline std::unique_ptr<Sampler> MakeSampler(SamplerType type, int samples_per_pixel,
+                                            uint64_t seed) {
+  if (type == SamplerType::kStratified)
+    return std::make_unique<StratifiedSampler>(samples_per_pixel, seed);
+  if (type == SamplerType::kSobol)
+    return std::make_unique<SobolSampler>(seed);
+  return std::make_unique<IndependentSampler>();
+}
+
+// Returns false if `name` is not a sampler.
+inline bool ParseSamplerType(const std::string& name, SamplerType& type) {
+  if (name == "independent")
+    type = SamplerType::kIndependent;
+  else if (name == "stratified")
+    type = SamplerType::kStratified;
+  else if (name == "sobol")
+    type = SamplerType::kSobol;
+  else
+    return false;
+  return true;
+}
+
+// The sampler of the calling thread's current render; independent outside of renders.
+inline Sampler*& ActiveSampler() {
+  static thread_local IndependentSampler fallback;
+  static thread_local Sampler* active = &fallback;
+  return active;
+}
+
+// Makes `sampler` the calling thread's active sampler for the lifetime of the scope.
+class SamplerScope {
+public:
+  explicit SamplerScope(Sampler* sampler) : previous_(ActiveSampler()) {
+    ActiveSampler() = sampler;
+  }
+
+  ~SamplerScope() { ActiveSampler() = previous_; }
+
+  SamplerScope(const SamplerScope&) = delete;
+  SamplerScope& operator=(const SamplerScope&) = delete;
+
+private:
+  Sampler* previous_;
+};
+
+// Next dimension(s) of the calling thread's current sample.
+inline double Sample1D() {
+  return ActiveSampler()->Get1D();
+}
+
+inline Point2 Sample2D() {
+  return ActiveSampler()->Get2D();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "arena.h"
+#include "camera.h"
+#include "common.h"
+#include "hittable_list.h"
+#include "topology.h"
+
+// Everything needed to render one image: the objects and the camera looking at them.
+struct Scene {
+  HittableList world;
+  Camera cam;
+};
+
+// Copies of a scene for NUMA nodes 1 and up, node 0 being the original's. Each copy is built
+// by `build(Scene&)` on a thread pinned to its node, seeded with `seed`, into an arena of its
+// own, or on the heap if `arena` is false; under first-touch placement its primitives, BVH
+// nodes and textures then live in that node's memory. `build` must make the same scene every
+// time it is called with the same seed. Stops at the first copy that `build` fails, so that
+// a short result, of n copies, means that node n + 1 has none.
+template <class Build>
+std::vector<Scene> BuildNodeReplicas(Build&& build, uint64_t seed, bool arena = true) {
+  std::vector<Scene> replicas(CpuTopology::Get().NodeCount() - 1);
+  for (size_t n = 0; n < replicas.size(); n++) {
+    bool ok = false;
+    RunOnNode(int(n + 1), [&] {
+      SeedRandom(seed);
+      ArenaScope arena_scope(arena ? make_shared<Arena>() : nullptr);
+      ok = build(replicas[n]);
+    });
+    if (!ok) {
+      replicas.resize(n);
+      break;
+    }
+  }
+  return replicas;
+}
@@ -0,0 +1,711 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "bvh.h"
+#include "camera.h"
+#include "common.h"
+#include "constant_medium.h"
+#include "density_grid.h"
+#include "heterogeneous_medium.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "quad.h"
+#include "scene.h"
+#include "sphere.h"
+#include "texture.h"
+#include "vec3.h"
+
+// Scene description files.
+//
+// Text form (*.scene): one statement per line, '#' starts a comment. Every texture,
+// material and object gets a name, and may only refer to names defined above it. Wherever a
+// <texture> is expected, an inline color "r g b" works too.
+//
+//   camera      <key> <value> ...  aspect_ratio, image_width, samples_per_pixel, max_depth,
+//                                  vfov, defocus_angle, focus_dist take one number;
+//                                  background, lookfrom, lookat, vup take three
+//   texture     <name> solid <r g b>
+//   texture     <name> checker <scale> <even texture> <odd texture>
+//   texture     <name> image <file>
+//   texture     <name> noise <scale> [bake <resolution> <min corner> <max corner>]
+//   material    <name> lambertian <texture>
+//   material    <name> metal <r g b> <fuzz>
+//   material    <name> dielectric <refraction index>
+//   material    <name> light <texture>
+//   material    <name> isotropic <texture>
+//   sphere      <name> <center> <radius> <material>
+//   sphere      <name> <center1> <center2> <radius> <material>       (moving)
+//   quad        <name> <origin> <u> <v> <material>                   (also triangle, ellipse)
+//   annulus     <name> <center> <u> <v> <inner radius> <material>
+//   box         <name> <corner a> <corner b> <material>
+//   group       <name> <object> ...
+//   bvh         <name> <object> ...
+//   translate   <name> <object> <offset>
+//   rotate_y    <name> <object> <degrees>
+//   medium      <name> <boundary object> <density> <texture>
+//   grid_medium <name> <grid file> <min corner> <max corner> <density scale> <texture>
+//   world       <object> ...
+//
+// A noise texture with `bake` precomputes its turbulence on a grid of resolution^3 samples
+// between the two corners, which should enclose the objects wearing it; see
+// NoiseTexture::Bake.
+//
+// An object may be referenced any number of times; that is how instancing works (one `box`
+// under several `translate`s shares its quads).
+//
+// Binary form (*.rtsb): the same records after name resolution, stored as raw arrays in
+// host byte order, so loading is a handful of reads and an index check, with no parsing.
+// Write it with SaveBinary; Load picks the format from the file's magic number.
+class SceneFile {
+public:
+  bool Load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+      std::cerr << "ERROR: Could not open scene file '" << filename << "'.\n";
+      return false;
+    }
+
+    char magic[4] = {};
+    in.read(magic, 4);
+    in.seekg(0);
+    if (in.gcount() == 4 && std::string(magic, 4) == std::string(kMagic, 4))
+      return LoadBinary(in, filename);
+    return LoadText(in, filename);
+  }
+
+  bool SaveBinary(const std::string& filename) const {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+      std::cerr << "ERROR: Could not write scene file '" << filename << "'.\n";
+      return false;
+    }
+
+    Header header;
+    header.node_count = uint32_t(nodes_.size());
+    header.ref_count = uint32_t(refs_.size());
+    header.world_count = uint32_t(world_.size());
+    header.string_count = uint32_t(strings_.size());
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&camera_), sizeof(camera_));
+    WriteArray(out, nodes_);
+    WriteArray(out, refs_);
+    WriteArray(out, world_);
+    for (const auto& s : strings_) {
+      uint32_t length = uint32_t(s.size());
+      out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+      out.write(s.data(), length);
+    }
+    return bool(out);
+  }
+
+  // Instantiate the described objects into scene.world and configure scene.cam.
+  void Build(Scene& scene) const {
+    std::vector<shared_ptr<Texture>> textures(nodes_.size());
+    std::vector<shared_ptr<Material>> materials(nodes_.size());
+    std::vector<shared_ptr<Hittable>> objects(nodes_.size());
+
+    for (size_t index = 0; index < nodes_.size(); index++) {
+      const Node& n = nodes_[index];
+      const double* p = n.param;
+      auto ref = [&](int i) { return refs_[n.first_ref + i]; };
+      auto vec = [&](int i) { return vec3(p[i], p[i + 1], p[i + 2]); };
+
+      switch (n.type) {
+        case NodeType::kSolid:
+          textures[index] = MakeShared<SolidColor>(vec(0));
+          break;
+        case NodeType::kChecker:
+          textures[index] = MakeShared<CheckerTexture>(p[0], textures[ref(0)],
+                                                       textures[ref(1)]);
+          break;
+        case NodeType::kImage:
+          textures[index] = MakeShared<ImageTexture>(strings_[n.string].c_str());
+          break;
+        case NodeType::kNoise: {
+          auto noise = MakeShared<NoiseTexture>(p[0]);
+          if (p[1] > 0)
+            noise->Bake(AABB(vec(2), vec(5)), int(p[1]));
+          textures[index] = noise;
+          break;
+        }
+
+        case NodeType::kLambertian:
+          materials[index] = MakeShared<Lambertian>(textures[ref(0)]);
+          break;
+        case NodeType::kMetal:
+          materials[index] = MakeShared<Metal>(vec(0), p[3]);
+          break;
+        case NodeType::kDielectric:
+          materials[index] = MakeShared<Dielectric>(p[0]);
+          break;
+        case NodeType::kLight:
+          materials[index] = MakeShared<DiffuseLight>(textures[ref(0)]);
+          break;
+        case NodeType::kIsotropic:
+          materials[index] = MakeShared<Isotropic>(textures[ref(0)]);
+          break;
+
+        case NodeType::kSphere:
+          objects[index] = MakeShared<Sphere>(vec(0), p[3], materials[ref(0)]);
+          break;
+        case NodeType::kMovingSphere:
+          objects[index] = MakeShared<Sphere>(vec(0), vec(3), p[6], materials[ref(0)]);
+          break;
+        case NodeType::kQuad:
+          objects[index] = MakeShared<Quad>(vec(0), vec(3), vec(6), materials[ref(0)]);
+          break;
+        case NodeType::kTriangle:
+          objects[index] = MakeShared<Triangle>(vec(0), vec(3), vec(6), materials[ref(0)]);
+          break;
+        case NodeType::kEllipse:
+          objects[index] = MakeShared<Ellipse>(vec(0), vec(3), vec(6), materials[ref(0)]);
+          break;
+        case NodeType::kAnnulus:
+          objects[index] = MakeShared<Annulus>(vec(0), vec(3), vec(6), p[9], materials[ref(0)]);
+          break;
+        case NodeType::kBox:
+          objects[index] = box(vec(0), vec(3), materials[ref(0)]);
+          break;
+        case NodeType::kTranslate:
+          objects[index] = MakeShared<Translate>(objects[ref(0)], vec(0));
+          break;
+        case NodeType::kRotateY:
+          objects[index] = MakeShared<RotateY>(objects[ref(0)], p[0]);
+          break;
+        case NodeType::kMedium:
+          objects[index] = MakeShared<ConstantMedium>(objects[ref(0)], p[0], textures[ref(1)]);
+          break;
+
+        case NodeType::kGroup:
+        case NodeType::kBvh: {
+          HittableList list;
+          for (int i = 0; i < n.ref_count; i++)
+            list.Add(objects[ref(i)]);
+          if (n.type == NodeType::kBvh)
+            objects[index] = MakeShared<BvhNode>(list);
+          else
+            objects[index] = MakeShared<HittableList>(list);
+          break;
+        }
+
+        case NodeType::kGridMedium: {
+          auto grid = MakeShared<DensityGrid>(DensityGrid::Load(strings_[n.string]));
+          objects[index] = MakeShared<HeterogeneousMedium>(grid, AABB(vec(0), vec(3)), p[6],
+                                                            textures[ref(0)]);
+          break;
+        }
+      }
+    }
+
+    for (auto index : world_)
+      scene.world.Add(objects[index]);
+
+    const CameraRecord& c = camera_;
+    scene.cam.aspect_ratio = c.aspect_ratio;
+    scene.cam.image_width = int(c.image_width);
+    scene.cam.samples_per_pixel = int(c.samples_per_pixel);
+    scene.cam.max_depth = int(c.max_depth);
+    scene.cam.background = color(c.background[0], c.background[1], c.background[2]);
+    scene.cam.vfov = c.vfov;
+    scene.cam.lookfrom = point3(c.lookfrom[0], c.lookfrom[1], c.lookfrom[2]);
+    scene.cam.lookat = point3(c.lookat[0], c.lookat[1], c.lookat[2]);
+    scene.cam.vup = vec3(c.vup[0], c.vup[1], c.vup[2]);
+    scene.cam.defocus_angle = c.defocus_angle;
+    scene.cam.focus_dist = c.focus_dist;
+  }
+
+private:
+  enum class NodeType : uint32_t {
+    // Textures
+    kSolid, kChecker, kImage, kNoise,
+    // Materials
+    kLambertian, kMetal, kDielectric, kLight, kIsotropic,
+    // Objects
+    kSphere, kMovingSphere, kQuad, kTriangle, kEllipse, kAnnulus, kBox,
+    kGroup, kBvh, kTranslate, kRotateY, kMedium, kGridMedium,
+  };
+
+  enum class Category { kTexture, kMaterial, kObject };
+
+  // One texture, material or object. References to other nodes are stored in refs_, and
+  // always point at lower indices, so Build can create nodes front to back.
+  struct Node {
+    NodeType type;
+    int32_t first_ref = 0;  // First entry in refs_
+    int32_t ref_count = 0;
+    int32_t string = -1;    // Index into strings_ (file names), -1 if unused
+    double param[10] = {};
+  };
+
+  // Camera fields, kept as plain doubles so the record can be written as-is.
+  struct CameraRecord {
+    double aspect_ratio, image_width, samples_per_pixel, max_depth;
+    double background[3];
+    double vfov;
+    double lookfrom[3], lookat[3], vup[3];
+    double defocus_angle, focus_dist;
+  };
+
+  static constexpr char kMagic[4] = {'R', 'T', 'S', 'B'};
+  static const uint32_t kVersion = 1;
+
+  struct Header {
+    char magic[4] = {kMagic[0], kMagic[1], kMagic[2], kMagic[3]};
+    uint32_t version = kVersion;
+    uint32_t node_count = 0;
+    uint32_t ref_count = 0;
+    uint32_t world_count = 0;
+    uint32_t string_count = 0;
+  };
+
+  // Splits one statement into tokens and converts them on demand. The first failure is
+  // remembered in `error`, later calls then return defaults.
+  struct LineParser {
+    std::vector<std::string> tokens;
+    size_t pos = 0;
+    std::string error;
+
+    bool Done() const { return pos >= tokens.size(); }
+
+    const std::string& Peek() const { return tokens[pos]; }
+
+    std::string Word() {
+      if (Done()) {
+        Fail("unexpected end of line");
+        return "";
+      }
+      return tokens[pos++];
+    }
+
+    double Number() {
+      std::string token = Word();
+      if (token.empty())
+        return 0;
+      char* end;
+      double value = std::strtod(token.c_str(), &end);
+      if (*end != '\0')
+        Fail("expected a number, got '" + token + "'");
+      return value;
+    }
+
+    vec3 Vector() {
+      double x = Number(), y = Number(), z = Number();
+      return vec3(x, y, z);
+    }
+
+    void Fail(const std::string& message) {
+      if (error.empty())
+        error = message;
+    }
+  };
+
+  template <typename T>
+  static void WriteArray(std::ostream& out, const std::vector<T>& v) {
+    out.write(reinterpret_cast<const char*>(v.data()), std::streamsize(v.size() * sizeof(T)));
+  }
+
+  template <typename T>
+  static bool ReadArray(std::istream& in, std::vector<T>& v, uint32_t count) {
+    v.resize(count);
+    in.read(reinterpret_cast<char*>(v.data()), std::streamsize(count * sizeof(T)));
+    return bool(in);
+  }
+
+  bool LoadBinary(std::istream& in, const std::string& filename) {
+    Header header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.version != kVersion) {
+      std::cerr << "ERROR: Unsupported binary scene file '" << filename << "'.\n";
+      return false;
+    }
+
+    in.read(reinterpret_cast<char*>(&camera_), sizeof(camera_));
+    bool ok = ReadArray(in, nodes_, header.node_count) &&
+              ReadArray(in, refs_, header.ref_count) &&
+              ReadArray(in, world_, header.world_count);
+
+    strings_.resize(header.string_count);
+    for (auto& s : strings_) {
+      uint32_t length = 0;
+      in.read(reinterpret_cast<char*>(&length), sizeof(length));
+      s.resize(length);
+      in.read(s.data(), length);
+    }
+
+    if (!ok || !in) {
+      std::cerr << "ERROR: Truncated binary scene file '" << filename << "'.\n";
+      return false;
+    }
+
+    std::string error = Validate();
+    if (!error.empty()) {
+      std::cerr << "ERROR: " << filename << ": " << error << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  // Check the records read from a binary file against everything that Build indexes with
+  // them, which the text parser guarantees by construction: known node types, references
+  // within refs_ to earlier nodes of the right category, string indices within strings_,
+  // world entries naming objects, and sane noise bake resolutions. Returns the first
+  // problem, or "" if there is none.
+  std::string Validate() const {
+    for (size_t index = 0; index < nodes_.size(); index++) {
+      const Node& n = nodes_[index];
+      std::string node = "node " + std::to_string(index);
+      if (uint32_t(n.type) > uint32_t(NodeType::kGridMedium))
+        return node + " has unknown type " + std::to_string(uint32_t(n.type));
+
+      std::vector<Category> expected = RefCategories(n.type);
+      bool list = n.type == NodeType::kGroup || n.type == NodeType::kBvh;
+      if (list ? n.ref_count < 1 : n.ref_count != int32_t(expected.size()))
+        return node + " has " + std::to_string(n.ref_count) + " references";
+      if (n.first_ref < 0 || size_t(n.first_ref) + size_t(n.ref_count) > refs_.size())
+        return node + " has references outside the reference table";
+
+      for (int i = 0; i < n.ref_count; i++) {
+        int32_t ref = refs_[n.first_ref + i];
+        Category category = list ? Category::kObject : expected[i];
+        if (ref < 0 || size_t(ref) >= index || CategoryOf(nodes_[ref].type) != category)
+          return node + " refers to node " + std::to_string(ref) +
+                 ", which is not an earlier " + CategoryName(category);
+      }
+
+      double bake = n.param[1];
+      if (n.type == NodeType::kNoise && bake != 0 && !(bake >= 2 && bake <= 1024))
+        return node + " has bake resolution " + std::to_string(bake);
+
+      bool has_string = n.type == NodeType::kImage || n.type == NodeType::kGridMedium;
+      if (has_string && (n.string < 0 || size_t(n.string) >= strings_.size()))
+        return node + " has string index " + std::to_string(n.string) + ", out of range";
+    }
+
+    for (int32_t index : world_) {
+      if (index < 0 || size_t(index) >= nodes_.size() ||
+          CategoryOf(nodes_[index].type) != Category::kObject)
+        return "world refers to node " + std::to_string(index) + ", which is not an object";
+    }
+    return "";
+  }
+
+  static Category CategoryOf(NodeType type) {
+    if (type <= NodeType::kNoise)
+      return Category::kTexture;
+    if (type <= NodeType::kIsotropic)
+      return Category::kMaterial;
+    return Category::kObject;
+  }
+
+  static const char* CategoryName(Category category) {
+    switch (category) {
+      case Category::kTexture:
+        return "texture";
+      case Category::kMaterial:
+        return "material";
+      default:
+        return "object";
+    }
+  }
+
+  // Categories of the references a node takes, in order. Groups and BVHs take any positive
+  // number of objects instead.
+  static std::vector<Category> RefCategories(NodeType type) {
+    switch (type) {
+      case NodeType::kChecker:
+        return {Category::kTexture, Category::kTexture};
+      case NodeType::kLambertian:
+      case NodeType::kLight:
+      case NodeType::kIsotropic:
+      case NodeType::kGridMedium:
+        return {Category::kTexture};
+      case NodeType::kSphere:
+      case NodeType::kMovingSphere:
+      case NodeType::kQuad:
+      case NodeType::kTriangle:
+      case NodeType::kEllipse:
+      case NodeType::kAnnulus:
+      case NodeType::kBox:
+        return {Category::kMaterial};
+      case NodeType::kTranslate:
+      case NodeType::kRotateY:
+        return {Category::kObject};
+      case NodeType::kMedium:
+        return {Category::kObject, Category::kTexture};
+      default:
+        return {};
+    }
+  }
+
+  bool LoadText(std::istream& in, const std::string& filename) {
+    SetCameraDefaults();
+
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); line_number++) {
+      auto comment = line.find('#');
+      if (comment != std::string::npos)
+        line.erase(comment);
+
+      LineParser parser;
+      std::istringstream words(line);
+      for (std::string token; words >> token;)
+        parser.tokens.push_back(token);
+      if (parser.tokens.empty())
+        continue;
+
+      ParseStatement(parser);
+      if (parser.error.empty() && !parser.Done())
+        parser.Fail("unexpected '" + parser.Peek() + "'");
+
+      if (!parser.error.empty()) {
+        std::cerr << "ERROR: " << filename << ':' << line_number << ": " << parser.error
+                  << '\n';
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void SetCameraDefaults() {
+    Camera cam;
+    camera_ = CameraRecord{cam.aspect_ratio,
+                           double(cam.image_width),
+                           double(cam.samples_per_pixel),
+                           double(cam.max_depth),
+                           {cam.background.x(), cam.background.y(), cam.background.z()},
+                           cam.vfov,
+                           {cam.lookfrom.x(), cam.lookfrom.y(), cam.lookfrom.z()},
+                           {cam.lookat.x(), cam.lookat.y(), cam.lookat.z()},
+                           {cam.vup.x(), cam.vup.y(), cam.vup.z()},
+                           cam.defocus_angle,
+                           cam.focus_dist};
+  }
+
+  void ParseStatement(LineParser& in) {
+    std::string keyword = in.Word();
+
+    if (keyword == "camera")
+      return ParseCamera(in);
+    if (keyword == "world") {
+      while (!in.Done())
+        world_.push_back(Reference(in, Category::kObject));
+      return;
+    }
+
+    std::string name = in.Word();
+    if (names_.count(name))
+      return in.Fail("'" + name + "' is already defined");
+
+    Node node;
+    std::vector<int32_t> refs;
+    Category category = Category::kObject;
+
+    if (keyword == "texture") {
+      category = Category::kTexture;
+      std::string kind = in.Word();
+      if (kind == "solid") {
+        node.type = NodeType::kSolid;
+        SetVector(node, 0, in.Vector());
+      } else if (kind == "checker") {
+        node.type = NodeType::kChecker;
+        node.param[0] = in.Number();
+        refs.push_back(TextureArgument(in));
+        refs.push_back(TextureArgument(in));
+      } else if (kind == "image") {
+        node.type = NodeType::kImage;
+        node.string = AddString(in.Word());
+      } else if (kind == "noise") {
+        node.type = NodeType::kNoise;
+        node.param[0] = in.Number();
+        if (!in.Done() && in.Peek() == "bake") {
+          in.Word();
+          node.param[1] = in.Number();  // Bake resolution, 0 = exact noise
+          SetVector(node, 2, in.Vector());
+          SetVector(node, 5, in.Vector());
+          if (node.param[1] < 2 || node.param[1] > 1024)
+            return in.Fail("bake resolution must be between 2 and 1024");
+        }
+      } else {
+        return in.Fail("unknown texture type '" + kind + "'");
+      }
+    } else if (keyword == "material") {
+      category = Category::kMaterial;
+      std::string kind = in.Word();
+      if (kind == "lambertian" || kind == "light" || kind == "isotropic") {
+        node.type = (kind == "lambertian") ? NodeType::kLambertian
+                    : (kind == "light")    ? NodeType::kLight
+                                           : NodeType::kIsotropic;
+        refs.push_back(TextureArgument(in));
+      } else if (kind == "metal") {
+        node.type = NodeType::kMetal;
+        SetVector(node, 0, in.Vector());
+        node.param[3] = in.Number();
+      } else if (kind == "dielectric") {
+        node.type = NodeType::kDielectric;
+        node.param[0] = in.Number();
+      } else {
+        return in.Fail("unknown material type '" + kind + "'");
+      }
+    } else if (keyword == "sphere") {
+      // Either <center> <radius> or <center1> <center2> <radius>, before the material.
+      size_t numbers = in.tokens.size() - in.pos - 1;
+      SetVector(node, 0, in.Vector());
+      if (numbers == 7) {
+        node.type = NodeType::kMovingSphere;
+        SetVector(node, 3, in.Vector());
+        node.param[6] = in.Number();
+      } else {
+        node.type = NodeType::kSphere;
+        node.param[3] = in.Number();
+      }
+      refs.push_back(Reference(in, Category::kMaterial));
+    } else if (keyword == "quad" || keyword == "triangle" || keyword == "ellipse" ||
+               keyword == "annulus") {
+      node.type = (keyword == "quad")       ? NodeType::kQuad
+                  : (keyword == "triangle") ? NodeType::kTriangle
+                  : (keyword == "ellipse")  ? NodeType::kEllipse
+                                            : NodeType::kAnnulus;
+      SetVector(node, 0, in.Vector());
+      SetVector(node, 3, in.Vector());
+      SetVector(node, 6, in.Vector());
+      if (node.type == NodeType::kAnnulus)
+        node.param[9] = in.Number();
+      refs.push_back(Reference(in, Category::kMaterial));
+    } else if (keyword == "box") {
+      node.type = NodeType::kBox;
+      SetVector(node, 0, in.Vector());
+      SetVector(node, 3, in.Vector());
+      refs.push_back(Reference(in, Category::kMaterial));
+    } else if (keyword == "group" || keyword == "bvh") {
+      node.type = (keyword == "group") ? NodeType::kGroup : NodeType::kBvh;
+      while (!in.Done())
+        refs.push_back(Reference(in, Category::kObject));
+      if (refs.empty())
+        return in.Fail("'" + keyword + "' needs at least one object");
+    } else if (keyword == "translate") {
+      node.type = NodeType::kTranslate;
+      refs.push_back(Reference(in, Category::kObject));
+      SetVector(node, 0, in.Vector());
+    } else if (keyword == "rotate_y") {
+      node.type = NodeType::kRotateY;
+      refs.push_back(Reference(in, Category::kObject));
+      node.param[0] = in.Number();
+    } else if (keyword == "medium") {
+      node.type = NodeType::kMedium;
+      refs.push_back(Reference(in, Category::kObject));
+      node.param[0] = in.Number();
+      refs.push_back(TextureArgument(in));
+    } else if (keyword == "grid_medium") {
+      node.type = NodeType::kGridMedium;
+      node.string = AddString(in.Word());
+      SetVector(node, 0, in.Vector());
+      SetVector(node, 3, in.Vector());
+      node.param[6] = in.Number();
+      refs.push_back(TextureArgument(in));
+    } else {
+      return in.Fail("unknown statement '" + keyword + "'");
+    }
+
+    if (!in.error.empty())
+      return;
+
+    names_[name] = {int32_t(nodes_.size()), category};
+    AddNode(node, refs);
+  }
+
+  void ParseCamera(LineParser& in) {
+    CameraRecord& c = camera_;
+    while (!in.Done() && in.error.empty()) {
+      std::string key = in.Word();
+      // clang-format off
+      if      (key == "aspect_ratio")      c.aspect_ratio = in.Number();
+      else if (key == "image_width")       c.image_width = in.Number();
+      else if (key == "samples_per_pixel") c.samples_per_pixel = in.Number();
+      else if (key == "max_depth")         c.max_depth = in.Number();
+      else if (key == "vfov")              c.vfov = in.Number();
+      else if (key == "defocus_angle")     c.defocus_angle = in.Number();
+      else if (key == "focus_dist")        c.focus_dist = in.Number();
+      else if (key == "background")        ReadVector(in, c.background);
+      else if (key == "lookfrom")          ReadVector(in, c.lookfrom);
+      else if (key == "lookat")            ReadVector(in, c.lookat);
+      else if (key == "vup")               ReadVector(in, c.vup);
+      else in.Fail("unknown camera setting '" + key + "'");
+      // clang-format on
+    }
+  }
+
+  static void ReadVector(LineParser& in, double* out) {
+    vec3 v = in.Vector();
+    out[0] = v.x();
+    out[1] = v.y();
+    out[2] = v.z();
+  }
+
+  static void SetVector(Node& node, int first, const vec3& v) {
+    node.param[first] = v.x();
+    node.param[first + 1] = v.y();
+    node.param[first + 2] = v.z();
+  }
+
+  int32_t AddString(const std::string& s) {
+    strings_.push_back(s);
+    return int32_t(strings_.size() - 1);
+  }
+
+  int32_t AddNode(Node node, const std::vector<int32_t>& refs) {
+    node.first_ref = int32_t(refs_.size());
+    node.ref_count = int32_t(refs.size());
+    refs_.insert(refs_.end(), refs.begin(), refs.end());
+    nodes_.push_back(node);
+    return int32_t(nodes_.size() - 1);
+  }
+
+  // A name defined earlier in the file, which must be of the given category.
+  int32_t Reference(LineParser& in, Category category) {
+    std::string name = in.Word();
+    auto it = names_.find(name);
+    if (it == names_.end()) {
+      in.Fail("'" + name + "' is not defined");
+      return 0;
+    }
+    if (it->second.category != category) {
+      in.Fail("'" + name + "' has the wrong kind for this argument");
+      return 0;
+    }
+    return it->second.index;
+  }
+
+  // A texture name, or an inline "r g b" color that becomes an anonymous solid texture.
+  int32_t TextureArgument(LineParser& in) {
+    if (!in.Done() && names_.count(in.Peek()))
+      return Reference(in, Category::kTexture);
+
+    Node node;
+    node.type = NodeType::kSolid;
+    SetVector(node, 0, in.Vector());
+    return AddNode(node, {});
+  }
+
+private:
+  struct Name {
+    int32_t index;
+    Category category;
+  };
+
+  CameraRecord camera_;
+  std::vector<Node> nodes_;
+  std::vector<int32_t> refs_;
+  std::vector<int32_t> world_;
+  std::vector<std::string> strings_;
+  std::map<std::string, Name> names_;  // Only used while parsing text
+};
@@ -0,0 +1,524 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "bvh.h"
+#include "camera.h"
+#include "color.h"
+#include "common.h"
+#include "constant_medium.h"
+#include "density_grid.h"
+#include "heterogeneous_medium.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "perlin.h"
+#include "quad.h"
+#include "scene.h"
+#include "sphere.h"
+#include "texture.h"
+#include "vec3.h"
+
+// ----------------------------------------------------------------------------: scenes
+inline Scene BouncingSpheres() {
+  HittableList world;
+
+  auto checker = MakeShared<CheckerTexture>(0.32, color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+  world.Add(MakeShared<Sphere>(point3(0, -1000, 0), 1000, MakeShared<Lambertian>(checker)));
+
+  auto ground_material = MakeShared<Lambertian>(color(0.5, 0.5, 0.5));
+  world.Add(MakeShared<Sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+  for (int a = -11; a < 11; a++) {
+    for (int b = -11; b < 11; b++) {
+      auto choose_mat = RandomDouble();
+      point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+
+      if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+        shared_ptr<Material> Sphere_material;
+
+        if (choose_mat < 0.8) {
+          // diffuse
+          auto albedo = color::random() * color::random();
+          Sphere_material = MakeShared<Lambertian>(albedo);
+          auto center2 = center + vec3(0, RandomDouble(0, 0.5), 0);
+          world.Add(MakeShared<Sphere>(center, center2, 0.2, Sphere_material));
+        } else if (choose_mat < 0.95) {
+          // metal
+          auto albedo = color::random(0.5, 1);
+          auto fuzz = RandomDouble(0, 0.5);
+          Sphere_material = MakeShared<Metal>(albedo, fuzz);
+          world.Add(MakeShared<Sphere>(center, 0.2, Sphere_material));
+        } else {
+          // glass
+          Sphere_material = MakeShared<Dielectric>(1.5);
+          world.Add(MakeShared<Sphere>(center, 0.2, Sphere_material));
+        }
+      }
+    }
+  }
+
+  auto material1 = MakeShared<Dielectric>(1.5);
+  world.Add(MakeShared<Sphere>(point3(0, 1, 0), 1.0, material1));
+
+  auto material2 = MakeShared<Lambertian>(color(0.4, 0.2, 0.1));
+  world.Add(MakeShared<Sphere>(point3(-4, 1, 0), 1.0, material2));
+
+  auto material3 = MakeShared<Metal>(color(0.7, 0.6, 0.5), 0.0);
+  world.Add(MakeShared<Sphere>(point3(4, 1, 0), 1.0, material3));
+
+  world = HittableList(MakeShared<MotionBvhNode>(world));
+
+  Camera cam;
+
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0.70, 0.90, 1.00);
+
+  cam.vfov = 20;
+  cam.lookfrom = point3(13, 2, 3);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0.6;
+  cam.focus_dist = 10.0;
+
+  return Scene{world, cam};
+}
+
+inline Scene CheckeredSpheres() {
+  HittableList world;
+
+  auto checker = MakeShared<CheckerTexture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+
+  world.Add(MakeShared<Sphere>(point3(0, -10, 0), 10, MakeShared<Lambertian>(checker)));
+  world.Add(MakeShared<Sphere>(point3(0, 10, 0), 10, MakeShared<Lambertian>(checker)));
+
+  world = HittableList(MakeShared<BvhNode>(world));
+
+  Camera cam;
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0.70, 0.90, 1.00);
+
+  cam.vfov = 20;
+  cam.lookfrom = point3(13, 2, 3);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+  return Scene{world, cam};
+}
+
+inline Scene Earch() {
+  auto earth_texture = MakeShared<ImageTexture>("earthmap.jpg");
+  auto earth_surface = MakeShared<Lambertian>(earth_texture);
+  auto globe = MakeShared<Sphere>(point3(0, 0, 0), 2, earth_surface);
+
+  Camera cam;
+
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0.70, 0.90, 1.00);
+
+  cam.vfov = 20;
+  cam.lookfrom = point3(0, 0, 12);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{HittableList(globe), cam};
+}
+
+inline Scene PerlinSphere() {
+  HittableList world;
+
+  auto pertext = MakeShared<NoiseTexture>(4);
+  world.Add(MakeShared<Sphere>(point3(0, -1000, 0), 1000, MakeShared<Lambertian>(pertext)));
+  world.Add(MakeShared<Sphere>(point3(0, 2, 0), 2, MakeShared<Lambertian>(pertext)));
+
+  Camera cam;
+
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0.70, 0.90, 1.00);
+
+  cam.vfov = 20;
+  cam.lookfrom = point3(12, 2, 3);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene Quads() {
+  HittableList world;
+
+  // Materials
+  auto left_red = MakeShared<Lambertian>(color(1.0, 0.2, 0.2));
+  auto back_green = MakeShared<Lambertian>(color(0.2, 1.0, 0.2));
+  auto right_blue = MakeShared<Lambertian>(color(0.2, 0.2, 1.0));
+  auto upper_orange = MakeShared<Lambertian>(color(1.0, 0.5, 0.0));
+  auto lower_teal = MakeShared<Lambertian>(color(0.2, 0.8, 0.8));
+
+  // Quads
+  world.Add(MakeShared<Quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
+  world.Add(MakeShared<Quad>(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
+  world.Add(MakeShared<Quad>(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
+  world.Add(MakeShared<Quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
+  world.Add(MakeShared<Quad>(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal));
+
+  Camera cam;
+
+  cam.aspect_ratio = 1.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0.70, 0.90, 1.00);
+
+  cam.vfov = 80;
+  cam.lookfrom = point3(0, 0, 9);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene EasterEggs() {
+  HittableList world;
+
+  // Materials
+  auto red = MakeShared<Lambertian>(color(1.0, 0.2, 0.2));
+  auto green = MakeShared<Lambertian>(color(0.2, 1.0, 0.2));
+  auto blue = MakeShared<Lambertian>(color(0.2, 0.2, 1.0));
+  auto orange = MakeShared<Lambertian>(color(1.0, 0.5, 0.0));
+  auto teal = MakeShared<Lambertian>(color(0.2, 0.8, 0.8));
+
+  // Primitives: 2x2 grid layout
+  world.Add(MakeShared<Quad>(point3(-2.0, 0.1, 0), vec3(1.8, 0, 0), vec3(0, 1.8, 0), red));
+  world.Add(
+      MakeShared<Triangle>(point3(0.2, 0.1, 0), vec3(1.8, 0, 0), vec3(0, 1.8, 0), green));
+  world.Add(
+      MakeShared<Ellipse>(point3(-1.1, -1.1, 0), vec3(0.9, 0, 0), vec3(0, 0.9, 0), blue));
+  world.Add(MakeShared<Annulus>(point3(1.1, -1.1, 0), vec3(0.9, 0, 0), vec3(0, 0.9, 0), 0.5,
+                                 orange));
+
+  Camera cam;
+
+  cam.aspect_ratio = 1.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0.70, 0.90, 1.00);
+
+  cam.vfov = 20;
+  cam.lookfrom = point3(0, 0, 12);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene SimpleLights() {
+  HittableList world;
+
+  auto pertext = MakeShared<NoiseTexture>(4);
+  world.Add(MakeShared<Sphere>(point3(0, -1000, 0), 1000, MakeShared<Lambertian>(pertext)));
+  world.Add(MakeShared<Sphere>(point3(0, 2, 0), 2, MakeShared<Lambertian>(pertext)));
+
+  auto difflight = MakeShared<DiffuseLight>(color(4, 4, 4));
+  world.Add(MakeShared<Sphere>(point3(0, 7, 0), 2, difflight));
+  world.Add(MakeShared<Quad>(point3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), difflight));
+
+  Camera cam;
+
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = color(0, 0, 0);
+
+  cam.vfov = 20;
+  cam.lookfrom = point3(26, 3, 6);
+  cam.lookat = point3(0, 2, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene CornelBox() {
+  HittableList world;
+
+  auto red = MakeShared<Lambertian>(color(.65, .05, .05));
+  auto white = MakeShared<Lambertian>(color(.73, .73, .73));
+  auto green = MakeShared<Lambertian>(color(.12, .45, .15));
+  auto light = MakeShared<DiffuseLight>(color(15, 15, 15));
+
+  // clang-format off
+  world.Add(MakeShared<Quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+  world.Add(MakeShared<Quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+  world.Add(MakeShared<Quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105),
+                             light));
+  world.Add(MakeShared<Quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+  world.Add(MakeShared<Quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555),
+                             white));
+  world.Add(MakeShared<Quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+  // clang-format on
+
+  shared_ptr<Hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
+  box1 = MakeShared<RotateY>(box1, 15);
+  box1 = MakeShared<Translate>(box1, vec3(265, 0, 295));
+  world.Add(box1);
+
+  shared_ptr<Hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
+  box2 = MakeShared<RotateY>(box2, -18);
+  box2 = MakeShared<Translate>(box2, vec3(130, 0, 65));
+  world.Add(box2);
+
+  world = HittableList(MakeShared<BvhNode>(world));
+
+  Camera cam;
+
+  cam.aspect_ratio = 1.0;
+  cam.image_width = 600;
+  cam.samples_per_pixel = 200;
+  cam.max_depth = 50;
+  cam.background = color(0, 0, 0);
+
+  cam.vfov = 40;
+  cam.lookfrom = point3(278, 278, -800);
+  cam.lookat = point3(278, 278, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene CornellSmoke() {
+  HittableList world;
+
+  auto red = MakeShared<Lambertian>(color(.65, .05, .05));
+  auto white = MakeShared<Lambertian>(color(.73, .73, .73));
+  auto green = MakeShared<Lambertian>(color(.12, .45, .15));
+  auto light = MakeShared<DiffuseLight>(color(7, 7, 7));
+
+  world.Add(MakeShared<Quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+  world.Add(MakeShared<Quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+  world.Add(MakeShared<Quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light));
+  world.Add(MakeShared<Quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+  world.Add(MakeShared<Quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+  world.Add(MakeShared<Quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+  shared_ptr<Hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
+  box1 = MakeShared<RotateY>(box1, 15);
+  box1 = MakeShared<Translate>(box1, vec3(265, 0, 295));
+
+  shared_ptr<Hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
+  box2 = MakeShared<RotateY>(box2, -18);
+  box2 = MakeShared<Translate>(box2, vec3(130, 0, 65));
+
+  world.Add(MakeShared<ConstantMedium>(box1, 0.01, color(0, 0, 0)));
+  world.Add(MakeShared<ConstantMedium>(box2, 0.01, color(1, 1, 1)));
+
+  Camera cam;
+
+  cam.aspect_ratio = 1.0;
+  cam.image_width = 600;
+  cam.samples_per_pixel = 200;
+  cam.max_depth = 50;
+  cam.background = color(0, 0, 0);
+
+  cam.vfov = 40;
+  cam.lookfrom = point3(278, 278, -800);
+  cam.lookat = point3(278, 278, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene CornellCloud() {
+  HittableList world;
+
+  auto red = MakeShared<Lambertian>(color(.65, .05, .05));
+  auto white = MakeShared<Lambertian>(color(.73, .73, .73));
+  auto green = MakeShared<Lambertian>(color(.12, .45, .15));
+  auto light = MakeShared<DiffuseLight>(color(7, 7, 7));
+
+  world.Add(MakeShared<Quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+  world.Add(MakeShared<Quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+  world.Add(MakeShared<Quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light));
+  world.Add(MakeShared<Quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+  world.Add(MakeShared<Quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+  world.Add(MakeShared<Quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+  // A procedural cloud: a turbulent ball that fades out towards its rim. Everything outside
+  // the ball stays zero, so most bricks of the grid are never allocated.
+  const int n = 96;
+  auto cloud = MakeShared<DensityGrid>(n, n, n);
+  Perlin perlin;
+  for (int k = 0; k < n; k++) {
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < n; i++) {
+        point3 p = (point3(i, j, k) + vec3(0.5, 0.5, 0.5)) / n - vec3(0.5, 0.5, 0.5);
+        double falloff = 1 - 2.2 * p.length();
+        double density = falloff + 0.6 * perlin.Turb(4 * p, 5) - 0.3;
+        if (falloff > 0 && density > 0)
+          cloud->Set(i, j, k, float(density));
+      }
+    }
+  }
+
+  AABB bounds(point3(127, 100, 127), point3(427, 400, 427));
+  world.Add(MakeShared<HeterogeneousMedium>(cloud, bounds, 0.05, color(0.9, 0.9, 0.9)));
+
+  world = HittableList(MakeShared<BvhNode>(world));
+
+  Camera cam;
+
+  cam.aspect_ratio = 1.0;
+  cam.image_width = 600;
+  cam.samples_per_pixel = 200;
+  cam.max_depth = 50;
+  cam.background = color(0, 0, 0);
+
+  cam.vfov = 40;
+  cam.lookfrom = point3(278, 278, -800);
+  cam.lookat = point3(278, 278, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+inline Scene TheNextWeekFinalScene(int image_width, int samples_per_pixel, int max_depth) {
+  HittableList boxes1;
+  auto ground = MakeShared<Lambertian>(color(0.48, 0.83, 0.53));
+
+  int boxes_per_side = 20;
+  for (int i = 0; i < boxes_per_side; i++) {
+    for (int j = 0; j < boxes_per_side; j++) {
+      auto w = 100.0;
+      auto x0 = -1000.0 + i * w;
+      auto z0 = -1000.0 + j * w;
+      auto y0 = 0.0;
+      auto x1 = x0 + w;
+      auto y1 = RandomDouble(1, 101);
+      auto z1 = z0 + w;
+
+      boxes1.Add(box(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+    }
+  }
+
+  HittableList world;
+
+  world.Add(MakeShared<BvhNode>(boxes1));
+
+  auto light = MakeShared<DiffuseLight>(color(7, 7, 7));
+  world.Add(MakeShared<Quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), light));
+
+  auto center1 = point3(400, 400, 200);
+  auto center2 = center1 + vec3(30, 0, 0);
+  auto sphere_material = MakeShared<Lambertian>(color(0.7, 0.3, 0.1));
+  world.Add(MakeShared<Sphere>(center1, center2, 50, sphere_material));
+
+  world.Add(MakeShared<Sphere>(point3(260, 150, 45), 50, MakeShared<Dielectric>(1.5)));
+  world.Add(MakeShared<Sphere>(point3(0, 150, 145), 50,
+                                MakeShared<Metal>(color(0.8, 0.8, 0.9), 1.0)));
+
+  auto boundary = MakeShared<Sphere>(point3(360, 150, 145), 70, MakeShared<Dielectric>(1.5));
+  world.Add(boundary);
+  world.Add(MakeShared<ConstantMedium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+  boundary = MakeShared<Sphere>(point3(0, 0, 0), 5000, MakeShared<Dielectric>(1.5));
+  world.Add(MakeShared<ConstantMedium>(boundary, .0001, color(1, 1, 1)));
+
+  auto emat = MakeShared<Lambertian>(MakeShared<ImageTexture>("earthmap.jpg"));
+  world.Add(MakeShared<Sphere>(point3(400, 200, 400), 100, emat));
+  auto pertext = MakeShared<NoiseTexture>(0.2);
+  world.Add(MakeShared<Sphere>(point3(220, 280, 300), 80, MakeShared<Lambertian>(pertext)));
+
+  HittableList boxes2;
+  auto white = MakeShared<Lambertian>(color(.73, .73, .73));
+  int ns = 1000;
+  for (int j = 0; j < ns; j++) {
+    boxes2.Add(MakeShared<Sphere>(point3::random(0, 165), 10, white));
+  }
+
+  world.Add(MakeShared<Translate>(MakeShared<RotateY>(MakeShared<BvhNode>(boxes2), 15),
+                                   vec3(-100, 270, 395)));
+
+  Camera cam;
+
+  cam.aspect_ratio = 1.0;
+  cam.image_width = image_width;
+  cam.samples_per_pixel = samples_per_pixel;
+  cam.max_depth = max_depth;
+  cam.background = color(0, 0, 0);
+
+  cam.vfov = 40;
+  cam.lookfrom = point3(478, 278, -600);
+  cam.lookat = point3(278, 278, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  return Scene{world, cam};
+}
+
+// ----------------------------------------------------------------------------: registry
+struct SceneEntry {
+  const char* name;
+  Scene (*build)();
+};
+
+// clang-format off
+inline const std::vector<SceneEntry>& BuiltinScenes() {
+  static const std::vector<SceneEntry> scenes = {
+    // BVH on:  Render time: 52.8369s
+    // BVH off: Render time: 236.774s
+    {"bouncing-spheres",    BouncingSpheres},
+    {"checkered-spheres",   CheckeredSpheres},
+    {"earth",               Earch},
+    {"perlin-spheres",      PerlinSphere},
+    {"quads",               Quads},
+    {"easter-eggs",         EasterEggs},
+    {"simple-lights",       SimpleLights},
+    {"cornell-box",         CornelBox},  // Render time: 311.929s
+    {"cornell-smoke",       CornellSmoke},
+    // sweet dreams
+    {"final-scene",         [] { return TheNextWeekFinalScene(800, 10000, 40); }},
+    {"final-scene-preview", [] { return TheNextWeekFinalScene(400, 250, 4); }},
+    {"cornell-cloud",       CornellCloud},
+  };
+  return scenes;
+}
+// clang-format on
+
+// Returns the built-in scene called `name`, or nullptr.
+inline const SceneEntry* FindScene(const std::string& name) {
+  for (const auto& entry : BuiltinScenes())
+    if (name == entry.name)
+      return &entry;
+  return nullptr;
+}
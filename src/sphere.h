@@ -1,66 +1,158 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 #include "aabb.h"
 #include "common.h"
 #include "hittable.h"
 #include "interval.h"
+#include "material.h"
 #include "ray.h"
+#include "stats.h"
 #include "vec3.h"
 
 class Sphere : public Hittable {
 public:
   // Stationary Sphere
   Sphere(const point3& static_center, double radius, shared_ptr<Material> mat)
-      : center_(static_center, vec3(0, 0, 0)), radius_(std::fmax(0, radius)), mat_(mat) {
+      : center_(static_center, vec3(0, 0, 0)),
+        radius_(std::fmax(0, radius)),
+        mat_(mat),
+        uses_uv_(!mat || mat->UsesUV()) {
     auto half_diag = vec3(radius_, radius_, radius_);
     bbox_ = AABB(static_center - half_diag, static_center + half_diag);
   }
 
   // Moving Sphere
   Sphere(const point3& center1, const point3& center2, double radius, shared_ptr<Material> mat)
-      : center_(center1, center2 - center1), radius_(std::fmax(0, radius)), mat_(mat) {
+      : center_(center1, center2 - center1),
+        radius_(std::fmax(0, radius)),
+        mat_(mat),
+        uses_uv_(!mat || mat->UsesUV()) {
     auto rvec = vec3(radius_, radius_, radius_);
     AABB box1(center_.at(0) - rvec, center_.at(0) + rvec);
     AABB box2(center_.at(1) - rvec, center_.at(1) + rvec);
     bbox_ = AABB(box1, box2);
   }
 
+  // Sphere moving along a polyline: at centers[k] at time k / (centers.size() - 1), and
+  // linearly in between.
+  Sphere(const std::vector<point3>& centers, double radius, shared_ptr<Material> mat)
+      : center_(centers.front(), vec3(0, 0, 0)),
+        radius_(std::fmax(0, radius)),
+        mat_(mat),
+        uses_uv_(!mat || mat->UsesUV()) {
+    if (centers.size() > 1)
+      path_ = centers;
+
+    bbox_ = AABB::empty;
+    for (int k = 0; k <= MotionSegments(); k++)
+      bbox_ = AABB(bbox_, BoundingBoxAt(double(k) / MotionSegments()));
+  }
+
   bool Hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
-    https://tinyurl.com/5eynscbx
-    point3 current_center = center_.at(r.time());
-    vec3 oc = current_center - r.origin();
-    double a = r.direction().length_squared();
-    double h = dot(r.direction(), oc);
-    double c = oc.length_squared() - radius_ * radius_;
+    RT_STAT(primitive_tests[kStatSphere]);
 
-    double discriminant = h * h - a * c;
-    if (discriminant < 0)
+    https://tinyurl.com/5eynscbx
+    point3 current_center = CenterAt(r.time());
+    double t0, t1;
+    if (!SolveQuadratic(r, current_center, t0, t1))
       return false;
 
-    double sqrtd = std::sqrt(discriminant);
-
     // Find the nearest root that lies in the acceptable range.
-    double t = (h - sqrtd) / a;
+    double t = t0;
     if (!ray_t.Surrounds(t)) {
-      t = (h + sqrtd) / a;
+      t = t1;
       if (!ray_t.Surrounds(t))
         return false;
     }
 
     rec.t = t;
+    rec.object = this;
+    return true;
+  }
+
+  void FinalizeHit(const Ray& r, HitRecord& rec) const override {
     rec.p = r.at(rec.t);
-    vec3 outward_normal = (rec.p - current_center) / radius_;
+    vec3 outward_normal = (rec.p - CenterAt(r.time())) / radius_;
     rec.SetFaceNormal(r, outward_normal);
-    GetSphereUV(outward_normal, rec.u, rec.v);
+    if (uses_uv_)
+      GetSphereUV(outward_normal, rec.u, rec.v);
+    else
+      rec.u = rec.v = 0;
     rec.mat = mat_;
+  }
 
-    return true;
+  bool Occluded(const Ray& r, Interval ray_t) const override {
+    RT_STAT(primitive_tests[kStatSphere]);
+
+    double t0, t1;
+    if (!SolveQuadratic(r, CenterAt(r.time()), t0, t1))
+      return false;
+    return ray_t.Surrounds(t0) || ray_t.Surrounds(t1);
   }
 
   AABB BoundingBox() const override { return bbox_; }
 
+  AABB BoundingBoxAt(double time) const override {
+    auto rvec = vec3(radius_, radius_, radius_);
+    point3 center = CenterAt(time);
+    return AABB(center - rvec, center + rvec);
+  }
+
+  int MotionSegments() const override { return path_.empty() ? 1 : int(path_.size()) - 1; }
+
+  void Describe(SceneInfo& info, int bvh_depth) const override {
+    bool moving = !path_.empty() || !center_.direction().near_zero();
+    info.CountPrimitive(moving ? "moving sphere" : "sphere");
+  }
+
+  bool IsConvex() const override { return true; }
+
+  bool Span(const Ray& r, Interval& span) const override {
+    double t0, t1;
+    if (!SolveQuadratic(r, CenterAt(r.time()), t0, t1))
+      return false;
+
+    span = Interval(t0, t1);
+    return true;
+  }
+
 private:
+  point3 CenterAt(double time) const {
+    if (path_.empty())
+      return center_.at(time);
+
+    double segment = std::clamp(time, 0.0, 1.0) * (path_.size() - 1);
+    size_t k = std::min(size_t(segment), path_.size() - 2);
+    return path_[k] + (segment - k) * (path_[k + 1] - path_[k]);
+  }
+
+  // Ray parameters t0 <= t1 where the ray crosses the sphere, if it does. Solved in double
+  // even when real is float: for the radius-1000 ground spheres |oc|^2 - r^2 cancels to
+  // garbage in float, and bounce rays would hit the ground they start on.
+  bool SolveQuadratic(const Ray& r, const point3& center, double& t0, double& t1) const {
+    double a = 0, h = 0, oc_squared = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      double oc = double(center[axis]) - r.origin()[axis];
+      double d = r.direction()[axis];
+      a += d * d;
+      h += d * oc;
+      oc_squared += oc * oc;
+    }
+    double c = oc_squared - radius_ * radius_;
+
+    double discriminant = h * h - a * c;
+    if (discriminant < 0)
+      return false;
+
+    double sqrtd = std::sqrt(discriminant);
+    t0 = (h - sqrtd) / a;
+    t1 = (h + sqrtd) / a;
+    return true;
+  }
+
   static void GetSphereUV(const point3& p, double& u, double& v) {
     // p: a given point on the sphere of radius one, centered at the origin.
     // u: returned value [0,1] of angle around the Y axis from X=-1.
@@ -77,8 +169,10 @@ private:
   }
 
 private:
-  Ray center_;
+  Ray center_;                // Center and velocity of linear motion
+  std::vector<point3> path_;  // Polyline motion if not empty, replacing center_
   double radius_;
   shared_ptr<Material> mat_;
+  bool uses_uv_;  // Whether the material reads texture coordinates
   AABB bbox_;
 };
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// Render statistics. Each thread counts into its own RenderStats, and Camera::Render merges
+// them once a worker is done, so counting never touches shared memory.
+//
+// The counters are only compiled in when RAYTRACING_STATS is defined (CMake option of the
+// same name; the scene_bench target always defines it). Otherwise the RT_STAT macros expand
+// to nothing and cost nothing.
+
+// Primitive types with their own Hit counter
+enum StatPrimitive {
+  kStatSphere,
+  kStatQuad,  // Also triangles, ellipses and annuli
+  kStatConstantMedium,
+  kStatGridMedium,
+  kStatPrimitives
+};
+
+struct RenderStats {
+  static const int kDepths = 64;  // Histogram buckets; deeper bounces land in the last one
+
+  uint64_t camera_rays = 0;                       // Rays leaving the camera
+  uint64_t secondary_rays = 0;                    // Rays spawned by Material::Scatter
+  uint64_t box_tests = 0;                         // AABB slab tests (AABB::Hit and Clip)
+  uint64_t bvh_nodes_visited = 0;                 // BvhNode::Hit calls
+  uint64_t primitive_tests[kStatPrimitives] = {};  // Hit calls per primitive type
+  uint64_t scatters = 0;                          // Material::Scatter calls
+  uint64_t ray_depth[kDepths] = {};   // Rays traced at each bounce (0 = camera ray)
+  uint64_t path_depth[kDepths] = {};  // Paths that ended at each bounce
+
+  uint64_t Rays() const { return camera_rays + secondary_rays; }
+
+  uint64_t PrimitiveTests() const {
+    uint64_t total = 0;
+    for (auto count : primitive_tests)
+      total += count;
+    return total;
+  }
+
+  void Merge(const RenderStats& other) {
+    camera_rays += other.camera_rays;
+    secondary_rays += other.secondary_rays;
+    box_tests += other.box_tests;
+    bvh_nodes_visited += other.bvh_nodes_visited;
+    for (int i = 0; i < kStatPrimitives; i++)
+      primitive_tests[i] += other.primitive_tests[i];
+    scatters += other.scatters;
+    for (int i = 0; i < kDepths; i++) {
+      ray_depth[i] += other.ray_depth[i];
+      path_depth[i] += other.path_depth[i];
+    }
+  }
+
+  void Print(std::ostream& out) const {
+    static const char* kPrimitiveNames[kStatPrimitives] = {"sphere", "quad", "constant medium",
+                                                           "grid medium"};
+    double rays = Rays() > 0 ? double(Rays()) : 1;
+
+    out << "  camera rays       " << camera_rays << '\n'
+        << "  secondary rays    " << secondary_rays << '\n'
+        << "  box tests         " << box_tests << " (" << box_tests / rays << "/ray)\n"
+        << "  bvh nodes visited " << bvh_nodes_visited << " (" << bvh_nodes_visited / rays
+        << "/ray)\n";
+    for (int i = 0; i < kStatPrimitives; i++) {
+      if (primitive_tests[i] > 0)
+        out << "  " << std::left << std::setw(18)
+            << (std::string(kPrimitiveNames[i]) + " tests") << primitive_tests[i] << " ("
+            << primitive_tests[i] / rays << "/ray)\n";
+    }
+    out << "  scatters          " << scatters << '\n';
+
+    out << "  depth  rays          paths ended\n";
+    for (int i = 0; i < kDepths; i++) {
+      if (ray_depth[i] > 0 || path_depth[i] > 0)
+        out << "  " << std::left << std::setw(7) << i << std::setw(14) << ray_depth[i]
+            << path_depth[i] << '\n';
+    }
+  }
+};
+
+// The calling thread's counters.
+inline RenderStats& ThreadStats() {
+  static thread_local RenderStats stats;
+  return stats;
+}
+
+inline int StatDepth(int depth) {
+  return depth < RenderStats::kDepths ? depth : RenderStats::kDepths - 1;
+}
+
+// RT_STAT_TASK_BEGIN zeroes the calling thread's counters at the start of a task, and
+// RT_STAT_TASK_END adds them to `total`, locking `total_mutex`, at its end.
+#ifdef RAYTRACING_STATS
+#define RT_STAT(counter) (ThreadStats().counter++)
+#define RT_STAT_DEPTH(histogram, depth) (ThreadStats().histogram[StatDepth(depth)]++)
+#define RT_STAT_TASK_BEGIN() (ThreadStats() = RenderStats())
+#define RT_STAT_TASK_END(total, total_mutex)            \
+  do {                                                  \
+    std::lock_guard<std::mutex> stat_lock(total_mutex); \
+    (total).Merge(ThreadStats());                       \
+  } while (0)
+#else
+#define RT_STAT(counter) ((void)0)
+#define RT_STAT_DEPTH(histogram, depth) ((void)0)
+#define RT_STAT_TASK_BEGIN() ((void)0)
+#define RT_STAT_TASK_END(total, total_mutex) ((void)0)
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include "arena.h"
 #include "color.h"
 #include "common.h"
 #include "perlin.h"
@@ -12,6 +13,9 @@ public:
   virtual ~Texture() = default;
 
   virtual color Value(double u, double v, const point3& p) const = 0;
+
+  // Whether Value depends on the texture coordinates u and v
+  virtual bool UsesUV() const { return true; }
 };
 
 // ----------------------------------------------------------------------------: derived class
@@ -23,6 +27,8 @@ public:
 
   color Value(double u, double v, const point3& p) const override { return albedo_; }
 
+  bool UsesUV() const override { return false; }
+
 private:
   color albedo_;
 };
@@ -33,7 +39,7 @@ public:
       : scale_(1.0 / scale), even_(even), odd_(odd) {}
 
   CheckerTexture(double scale, const color& c1, const color& c2)
-      : CheckerTexture(scale, make_shared<SolidColor>(c1), make_shared<SolidColor>(c2)) {}
+      : CheckerTexture(scale, MakeShared<SolidColor>(c1), MakeShared<SolidColor>(c2)) {}
 
   color Value(double u, double v, const point3& p) const override {
     int x = int(std::floor(scale_ * p.x()));
@@ -45,6 +51,8 @@ public:
     return is_even ? even_->Value(u, v, p) : odd_->Value(u, v, p);
   }
 
+  bool UsesUV() const override { return even_->UsesUV() || odd_->UsesUV(); }
+
 private:
   double scale_;
   shared_ptr<Texture> even_;
@@ -80,11 +88,27 @@ class NoiseTexture : public Texture {
 public:
   NoiseTexture(double scale) : scale_(scale) {}
 
+  // Optional: precompute the turbulence over `bounds` (usually the bounding box of the
+  // object wearing this texture) at `resolution` samples per axis. Shading points outside
+  // `bounds` still evaluate the noise exactly.
+  void Bake(const AABB& bounds, int resolution) {
+    baked_ = NoiseVolume(perlin_, bounds, resolution, turb_depth_);
+  }
+
   color Value(double u, double v, const point3& p) const override {
-    return color(.5, .5, .5) * (1 + std::sin(scale_ * p.z() + 10 * perlin_.Turb(p, 7)));
+    double turb;
+    if (baked_.Empty() || !baked_.Lookup(p, turb))
+      turb = perlin_.Turb(p, turb_depth_);
+
+    return color(.5, .5, .5) * (1 + std::sin(scale_ * p.z() + 10 * turb));
   }
 
+  bool UsesUV() const override { return false; }
+
 private:
+  static const int turb_depth_ = 7;
+
   Perlin perlin_;
   double scale_;
+  NoiseVolume baked_;
 };
@@ -0,0 +1,133 @@
+// Merges accumulation files into one frame.
+//
+// Each file holds the sample sums and counts of a piece of a frame, as written by
+// `main --samples A:B --accumulation FILE`. Pieces rendered by any number of independent jobs
+// add up to the frame of all their samples, provided they share the image size and seed and
+// their sample ranges join into one range without overlaps or gaps; anything else is an
+// error, as it would double-count samples or mix frames.
+//
+// usage: merge [-o image.ppm] [--accumulation merged] piece...
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "accumulation.h"
+
+namespace {
+
+const char* kUsage = R"(usage: merge [options] piece...
+
+  piece               accumulation file written by main --accumulation
+
+options:
+  -o, --output FILE   write the PPM image to FILE instead of stdout
+  --accumulation FILE write the merged sums and counts to FILE, to merge again later; the
+                      image is then only written with -o
+)";
+
+struct Options {
+  std::string output;        // empty = stdout
+  std::string accumulation;  // empty = none
+  std::vector<std::string> pieces;
+};
+
+bool ParseOptions(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if ((arg == "-o" || arg == "--output") && has_value) {
+      opt.output = argv[++i];
+    } else if (arg == "--accumulation" && has_value) {
+      opt.accumulation = argv[++i];
+    } else if (arg == "-h" || arg == "--help") {
+      return false;
+    } else if (!arg.empty() && arg[0] != '-') {
+      opt.pieces.push_back(arg);
+    } else {
+      std::cerr << "ERROR: bad option '" << arg << "'\n";
+      return false;
+    }
+  }
+  return !opt.pieces.empty();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!ParseOptions(argc, argv, opt)) {
+    std::cerr << kUsage;
+    return 1;
+  }
+
+  std::vector<std::pair<std::string, Accumulation>> pieces;
+  for (const auto& filename : opt.pieces) {
+    std::ifstream in(filename, std::ios::binary);
+    Accumulation piece;
+    if (!in || !piece.Read(in)) {
+      std::cerr << "ERROR: Could not read accumulation '" << filename << "'.\n";
+      return 1;
+    }
+    pieces.emplace_back(filename, std::move(piece));
+  }
+
+  // In sample order, every piece has to start where the previous one ended.
+  std::stable_sort(pieces.begin(), pieces.end(), [](const auto& a, const auto& b) {
+    return a.second.FirstSample() < b.second.FirstSample();
+  });
+  Accumulation frame = pieces[0].second;
+  for (size_t i = 1; i < pieces.size(); i++) {
+    const auto& [filename, piece] = pieces[i];
+    const auto& [previous_name, previous] = pieces[i - 1];
+    if (piece.Width() != frame.Width() || piece.Height() != frame.Height()) {
+      std::cerr << "ERROR: '" << filename << "' is " << piece.Width() << " x "
+                << piece.Height() << ", '" << previous_name << "' " << frame.Width() << " x "
+                << frame.Height() << ".\n";
+      return 1;
+    }
+    if (piece.Seed() != frame.Seed()) {
+      std::cerr << "ERROR: '" << filename << "' was rendered with seed " << piece.Seed()
+                << ", '" << previous_name << "' with seed " << frame.Seed() << ".\n";
+      return 1;
+    }
+    if (piece.FirstSample() < previous.LastSample()) {
+      std::cerr << "ERROR: Samples [" << piece.FirstSample() << ", " << piece.LastSample()
+                << ") of '" << filename << "' overlap samples [" << previous.FirstSample()
+                << ", " << previous.LastSample() << ") of '" << previous_name << "'.\n";
+      return 1;
+    }
+    if (piece.FirstSample() > previous.LastSample()) {
+      std::cerr << "ERROR: Samples [" << previous.LastSample() << ", " << piece.FirstSample()
+                << ") are missing between '" << previous_name << "' and '" << filename
+                << "'.\n";
+      return 1;
+    }
+    frame.Add(piece);
+  }
+
+  if (!opt.accumulation.empty()) {
+    std::ofstream out(opt.accumulation, std::ios::binary);
+    frame.Write(out);
+    if (!out) {
+      std::cerr << "ERROR: Could not write accumulation '" << opt.accumulation << "'.\n";
+      return 1;
+    }
+    if (opt.output.empty())
+      return 0;
+  }
+
+  if (opt.output.empty()) {
+    frame.WriteImage(std::cout);
+  } else {
+    std::ofstream out(opt.output);
+    if (!out) {
+      std::cerr << "ERROR: Could not write image '" << opt.output << "'.\n";
+      return 1;
+    }
+    frame.WriteImage(out);
+  }
+  return 0;
+}